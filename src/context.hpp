@@ -26,7 +26,14 @@ class Context {
 public:
 	virtual ~Context() = default;
 
-	virtual void loop_run(float delta_t) = 0;
+	// Advances the simulation by exactly `fixed_dt` seconds, called zero or more times per frame
+	virtual void update([[maybe_unused]] float fixed_dt) {};
+	// Draws the state `alpha` of the way from the one before the last update to the last one (alpha in [0, 1])
+	// alpha is 1, the last state, with --lockstep and --sim-thread
+	virtual void render(float alpha) = 0;
+	// Whether update() may run on the simulation thread, concurrently with render() (see Simulation_thread)
+	// The state is then handed to render() through a Lib::Triple_buffer, and alpha is 1 (the latest state)
+	[[nodiscard]] virtual bool is_threadable() const { return false; }
 	// Called when switching to this context
 	virtual void start() {};
 };
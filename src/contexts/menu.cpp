@@ -19,12 +19,13 @@
 #include "../main.hpp"
 #include "scene_3d.hpp"
 #include "scene_2d.hpp"
+#include "../renderer/program_cache.hpp"
 
 #include <imgui/imgui.h>
 
 namespace Engine::Contexts {
 
-void Menu::loop_run([[maybe_unused]] float delta_t)
+void Menu::render([[maybe_unused]] float alpha)
 {
 	Main* main = Main::get();
 	ImGui::SetNextWindowPos(ImVec2{main->display_width / 2.f, main->display_height / 2.f}, 0, ImVec2{.5f, .5f});
@@ -35,12 +36,10 @@ void Menu::loop_run([[maybe_unused]] float delta_t)
 		show_help = !show_help;
 	}
 	if (ImGui::Button("OpenGL triangle")) {
-		new_ctx = std::make_unique<Scene3D>(*renderer, Renderer::Triangle::get());
-		Context_holder::get().set_context(new_ctx.get());
+		open("triangle");
 	}
 	if (ImGui::Button("OpenGL plane")) {
-		new_ctx = std::make_unique<Scene2D>(*renderer);
-		Context_holder::get().set_context(new_ctx.get());
+		open("plane");
 	}
 	/*if (ImGui::Button("Simulation 3")) {
 		// TODO
@@ -49,6 +48,9 @@ void Menu::loop_run([[maybe_unused]] float delta_t)
 		// TODO
 	}*/
 
+	const Renderer::Program_cache::Stats& program_stats = Renderer::Program_cache::get().get_stats();
+	ImGui::Text("Programs: %u cached (%.1fms), %u compiled (%.1fms)", program_stats.hits, program_stats.load_ms, program_stats.compiled, program_stats.compile_ms);
+
 #ifndef EMSCRIPTEN
 	if (ImGui::Button("Exit")) {
 		Main::get()->terminate();
@@ -63,9 +65,24 @@ void Menu::loop_run([[maybe_unused]] float delta_t)
 	}
 }
 
-Menu::Menu()
+bool Menu::open(std::string_view scene)
 {
-	renderer = std::make_unique<Renderer::Renderer>();
+	std::unique_ptr<Context> ctx;
+	if (scene == "triangle") {
+		ctx = std::make_unique<Scene3D>(Renderer::Triangle::get());
+	}
+	else if (scene == "plane") {
+		ctx = std::make_unique<Scene2D>();
+	}
+	else {
+		return false;
+	}
+	// Switches before deleting the previous scene
+	Context_holder::get().set_context(ctx.get());
+	new_ctx = std::move(ctx);
+	return true;
 }
 
+Menu::Menu() = default;
+
 } // namespace Engine::Contexts
@@ -21,8 +21,8 @@
 #define SIMULATION_MENU_HPP
 
 #include <memory>
+#include <string_view>
 #include "../context.hpp"
-#include "../renderer/renderer.hpp"
 
 namespace Engine::Contexts {
 
@@ -30,11 +30,13 @@ class Menu final : public Context {
 public:
 	Menu();
 	~Menu() final = default;
-	void loop_run(float delta_t) final;
+	void render(float alpha) final;
+
+	// Switches to the named scene ("triangle" or "plane"), returns false if there is no such scene
+	bool open(std::string_view scene);
 
 private:
 	bool show_help = false;
-	std::unique_ptr<Renderer::Renderer> renderer;
 	std::unique_ptr<Context> new_ctx;
 };
 
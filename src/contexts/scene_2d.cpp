@@ -16,44 +16,94 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "scene_2d.hpp"
+#include "../frame_arena.hpp"
 #include "../main.hpp"
+#include "../profiler.hpp"
+#include "../lib/job_system.hpp"
+#include "../renderer/gl_state.hpp"
 
 #include <imgui/imgui.h>
 #include <glm/vec2.hpp>
+#include <glm/ext/matrix_transform.hpp>
 
 using glm::vec2, glm::vec3;
 
 namespace Engine::Contexts {
 
-Scene2D::Scene2D(const Renderer::Renderer& renderer):
-		renderer(renderer), camera(Main::get()->display_height, Main::get()->display_width), blitter(renderer),
-		texture(Renderer::Image("data/debug_tex.png"))
-		//texture(Renderer::bw_checker)
+Scene2D::Scene2D():
+		camera(Main::get()->display_height, Main::get()->display_width), blitter(),
+		async_texture(Renderer::Texture_loader::get().load("data/debug_tex.png"))
 {
-	renderer.use_program();
-	renderer.set_proj_matrix(camera.get_proj_matrix());
-	renderer.set_view_matrix(camera.get_view_matrix());
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glBlendEquation(GL_FUNC_ADD);
+	blitter.set_blend_mode(Renderer::Blend_mode::alpha);
+	blitter.set_batching(batching);
 }
 
-void Scene2D::loop_run([[maybe_unused]] float delta_t)
+void Scene2D::update(float fixed_dt)
 {
-	anim_t += time_warp * delta_t;
+	state.prev_anim_t = state.anim_t;
+	state.anim_t += time_warp.load(std::memory_order_relaxed) * fixed_dt;
+	states.back() = state;
+	states.publish();
+}
+
+void Scene2D::render(float alpha)
+{
+	states.acquire();
+	const State& latest = states.front();
+	const float t = latest.prev_anim_t + (latest.anim_t - latest.prev_anim_t) * alpha;
+	Renderer::Camera_uniforms::get().update(camera);
+	const Renderer::Texture& texture = async_texture->get(); // bw_checker until loaded
 
 	ImGui::SetNextWindowPos({0, 0}); // Top-Left corner
 	ImGui::Begin("Scene 2D Options", nullptr, 0);
 
-	ImGui::Text("render time: %.3fs (%i FPS)", delta_t, static_cast<int>(1./delta_t));
-	ImGui::Text("animation frame: %.3fs", anim_t);
+	ImGui::Text("animation frame: %.3fs", t);
+	if (ImGui::Checkbox("Batching", &batching)) {
+		blitter.set_batching(batching);
+	}
+	const Renderer::Batch_stats& stats = blitter.get_stats();
+	ImGui::Text("draws: %u submitted, %u issued (%u batched vertices)", stats.submitted_draws, stats.issued_draws, stats.vertices);
+	ImGui::SliderInt("Stress sprites", &stress_sprites, 0, 50000);
+	ImGui::SliderInt("Stress springs", &stress_springs, 0, 100000);
+	ImGui::SliderInt("Stress discs", &stress_discs, 0, 100000);
+
+	PROFILE_SCOPE("Scene2D: submit");
+	blitter.set_layer(0);
+	for (int it = 0; it < stress_sprites; it++) {
+		vec2 pos((it * 8) % 1280, ((it * 8) / 1280 * 8) % 720);
+		blitter.blit(texture, vec2(0), texture.get_dimensions(), pos, vec2(8), vec2(4), t + it, glm::vec4(1., 1., 1., .5));
+	}
 
-	blitter.blit(texture, vec2((1280 - texture.get_width())/2., (720 - texture.get_height())/2.), -anim_t * PI/10.f);
+	blitter.blit(texture, vec2((1280 - texture.get_width())/2., (720 - texture.get_height())/2.), -t * PI/10.f);
 	blitter.blit(texture, vec2(1280/2., 720/2. - texture.get_height()), glm::vec4(1., .5, .5, 1.));
-	blitter.blit(texture, vec2(0), vec2(texture.get_width(), texture.get_height()), vec2(1280/4., 3*720/4.), vec2(200., 200.), {50, 50}, anim_t * PI/20.f);
+	blitter.blit(texture, vec2(0), vec2(texture.get_width(), texture.get_height()), vec2(1280/4., 3*720/4.), vec2(200., 200.), {50, 50}, t * PI/20.f);
 	blitter.blit(texture, vec2(0), vec2(texture.get_width()*2, texture.get_height()), vec2(0), vec2(1280/2., 720/2.));
 	blitter.blit(texture, vec2(0), vec2(texture.get_width(), texture.get_height()), vec2(1280/2., 720/2.), vec2(1280/2., 720/2.));
 
+	// Shapes over the sprites
+	blitter.set_layer(1);
+	Lib::Job_system& jobs = Lib::Job_system::get();
+	Frame_vector<GLfloat> springs(stress_springs * 4); // segments, rebuilt each frame
+	jobs.parallel_for("Scene2D: springs", 0, stress_springs, 4096, [&](size_t from, size_t to) {
+		for (size_t it = from; it < to; it++) {
+			const vec2 start((it * 4) % 1280, ((it * 4) / 1280 * 4) % 720);
+			const vec2 end = start + 3.f * vec2(cosf(t + it), sinf(t + it));
+			GLfloat* segment = &springs[it * 4];
+			segment[0] = start.x; segment[1] = start.y; segment[2] = end.x; segment[3] = end.y;
+		}
+	});
+	blitter.lines(springs, 1.5f, {1., 1., 0., .6});
+
+	Frame_vector<Renderer::Disc_instance> particles(stress_discs);
+	jobs.parallel_for("Scene2D: particles", 0, stress_discs, 4096, [&](size_t from, size_t to) {
+		for (size_t it = from; it < to; it++) {
+			const vec2 center((it * 6) % 1280, ((it * 6) / 1280 * 6) % 720);
+			particles[it] = {center, 2.f + std::abs(sinf(t + it)), {255, 128, 32, 160}};
+		}
+	});
+	blitter.discs(particles);
+
 	blitter.rect_filled({0, 0}, {180, 108}, {0, 0, 0, .3});
 	blitter.rect_filled({0, 0}, {50, 100}, {0, 0, 1, .5}, 3.141592/6.f);
 	blitter.rect_filled({50, 0}, {50, 100}, {1, 1, 1, .5}, 3.141592/5.f);
@@ -63,22 +113,30 @@ void Scene2D::loop_run([[maybe_unused]] float delta_t)
 	blitter.stream_vertices({0, 300,  10, 400,  100, 400}, GL_TRIANGLES, {1., 0., 0., 1.});
 	blitter.polyline({400, 400,   500, 400,   500, 500,   600, 500,   600, 600}, 5.f, {0., 1., 0., 1.});
 	blitter.polygon({400, 200,   500, 200,   550, 300,   450, 300}, 8.f, {0., 0., 1., 1.});
-	blitter.circle({800, 550}, std::abs(cosf(anim_t)) * 149 + 1, 1.5f);
-	blitter.disc({800, 250}, std::abs(cosf(anim_t)) * 149 + 1, {.1, .3, .6, 1});
+	blitter.polygon_filled({1000, 100,   1200, 100,   1200, 300,   1150, 300,   1150, 150,   1050, 150,   1050, 300,   1000, 300}, {.8, .4, .1, 1.});
+	const glm::mat4 body_m4 = glm::rotate(glm::translate(glm::mat4(1.f), vec3(1100, 500, 0)), t, vec3(0, 0, 1));
+	blitter.polygon_filled(1, {-50, -50,   50, -50,   50, -20,   -20, -20,   -20, 50,   -50, 50}, body_m4, {.6, .1, .6, 1.});
+	blitter.circle({800, 550}, std::abs(cosf(t)) * 149 + 1, 1.5f);
+	blitter.disc({800, 250}, std::abs(cosf(t)) * 149 + 1, {.1, .3, .6, 1});
 
 	glm::vec2 dim, center{1280/2., 720/2.};
-	dim = {200, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .8, .2, 1}, anim_t * PI/20.f);
-	dim = {175, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .7, .2, 1}, anim_t * PI/15.f);
-	dim = {150, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .6, .2, 1}, anim_t * PI/10.f);
-	dim = {125, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .5, .2, 1}, anim_t * PI/05.f);
-
-	ImGui::SliderFloat("Warp time", &time_warp, 0.01, 1.);
+	dim = {200, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .8, .2, 1}, t * PI/20.f);
+	dim = {175, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .7, .2, 1}, t * PI/15.f);
+	dim = {150, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .6, .2, 1}, t * PI/10.f);
+	dim = {125, 50}; blitter.rect(center - dim / 2.f, dim, 1.5, {.2, .5, .2, 1}, t * PI/05.f);
+
+	float warp = time_warp.load(std::memory_order_relaxed);
+	if (ImGui::SliderFloat("Warp time", &warp, 0.01, 1.)) {
+		time_warp.store(warp, std::memory_order_relaxed);
+	}
 
 	if (ImGui::Button("Back to Menu")) {
 		Context_holder::get().set_context(Context_holder::get().menu);
 	}
 
 	ImGui::End();
+
+	blitter.flush();
 }
 
 void Scene2D::start()
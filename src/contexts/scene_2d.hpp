@@ -25,23 +25,40 @@
 #include "../renderer/renderer.hpp"
 #include "../renderer/blit.hpp"
 #include "../renderer/texture.hpp"
+#include "../renderer/texture_loader.hpp"
+#include "../lib/triple_buffer.hpp"
+
+#include <atomic>
+#include <memory>
+#include <vector>
 
 namespace Engine::Contexts {
 
 class Scene2D: public Context {
 public:
-	explicit Scene2D(const Renderer::Renderer& renderer);
+	Scene2D();
 
-	void loop_run(float delta_t) override;
+	void update(float fixed_dt) override;
+	void render(float alpha) override;
+	[[nodiscard]] bool is_threadable() const override { return true; }
 	void start() override;
 private:
-	const Renderer::Renderer& renderer;
 	Renderer::Camera2D camera;
 	Renderer::Blitter blitter;
-	Renderer::Texture texture;
+	std::shared_ptr<Renderer::Async_texture> async_texture;
 
-	float anim_t = 0;
-	float time_warp = 1;
+	// Simulation state, written by update()
+	struct State {
+		float anim_t = 0;
+		float prev_anim_t = 0; // anim_t before the last update, for the interpolation
+	};
+	State state;
+	Lib::Triple_buffer<State> states; // published by update(), read by render()
+	std::atomic<float> time_warp{1};
+	bool batching = true;
+	int stress_sprites = 0;
+	int stress_springs = 0;
+	int stress_discs = 0;
 };
 
 } // namespace Engine::Contexts
@@ -18,35 +18,86 @@
 #include "scene_3d.hpp"
 #include "../renderer/utils.hpp"
 #include "../main.hpp"
+#include "../profiler.hpp"
+#include "../lib/job_system.hpp"
 
 #include <imgui/imgui.h>
 
 #include <glm/ext/matrix_transform.hpp>
 
+#include <cmath>
+
 namespace Engine::Contexts {
 
+namespace {
+
+// Components of the instanced cubes
+struct Position {
+	glm::vec3 value;
+};
+
+struct Spin {
+	float prev_angle; // before the last update
+	float angle; // around (1, 1, 0)
+	float speed; // radians per second
+};
+
+struct Tint {
+	glm::vec4 value;
+};
+
+constexpr float cube_spacing = .1f;
+
+} // namespace
+
 void Scene3D::start()
 {
+	renderer.use_program();
 	renderer.set_tint_colour(glm::vec4(1.));
 }
 
-void Scene3D::loop_run([[maybe_unused]] float delta_t)
+void Scene3D::update(float fixed_dt)
 {
-	anim_t += delta_t;
-	camera.set_pos({0, 0, .5 + glm::abs(glm::cos(anim_t))});
+	update_cubes(fixed_dt);
+
+	State& next = states.back();
+	next.prev_anim_t = anim_t;
+	anim_t += fixed_dt;
+	next.anim_t = anim_t;
+	write_cubes(next.cubes);
+	states.publish();
+}
+
+void Scene3D::render(float alpha)
+{
+	states.acquire();
+	const State& latest = states.front();
+	const float t = latest.prev_anim_t + (latest.anim_t - latest.prev_anim_t) * alpha;
+	camera.set_pos({0, 0, .5 + glm::abs(glm::cos(t))});
 	camera.update_camera();
-	renderer.set_proj_matrix(camera.get_proj_matrix());
-	renderer.set_view_matrix(camera.get_view_matrix());
+	Renderer::Camera_uniforms::get().update(camera);
+	renderer.use_program();
 	renderer.set_model_matrix(model_m4);
-	renderer.set_has_texture(false);
 	mesh.draw(prim_type_values[prim_type_selected]);
-#ifndef NDEBUG
-	Renderer::check_gl_error("Scene3D::loop_run");
-#endif
+
+	if (!latest.cubes.empty()) {
+		write_instances(latest.cubes, alpha);
+		instance_buffer.update(instances);
+		glEnable(GL_DEPTH_TEST);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		instanced_renderer.use_program();
+		instanced_renderer.set_tint_colour(glm::vec4(1.));
+		Renderer::Cube::get().draw_instanced(instance_buffer, prim_type_values[prim_type_selected]);
+		glDisable(GL_DEPTH_TEST);
+	}
 	ImGui::SetNextWindowPos({0, 0}); // Top-Left corner
 	ImGui::Begin("Scene 3D Options", nullptr, 0);
 
 	ImGui::Combo("Primitive type", &prim_type_selected, prim_type_names, IM_ARRAYSIZE(prim_type_names), IM_ARRAYSIZE(prim_type_names));
+	int count = instance_count.load(std::memory_order_relaxed);
+	if (ImGui::SliderInt("Instanced cubes", &count, 0, 100000)) {
+		instance_count.store(count, std::memory_order_relaxed);
+	}
 	if (ImGui::Button("Back to Menu")) {
 		Context_holder::get().set_context(Context_holder::get().menu);
 	}
@@ -54,13 +105,76 @@ void Scene3D::loop_run([[maybe_unused]] float delta_t)
 	ImGui::End();
 }
 
-Scene3D::Scene3D(const Renderer::Renderer& renderer, const Renderer::Static_indexed_mesh& mm):
-	renderer(renderer),
+// Spawns or destroys cubes to match `instance_count`, lays them out in a cube grid in front of the camera and spins them
+void Scene3D::update_cubes(float fixed_dt)
+{
+	PROFILE_SCOPE("Scene3D::update_cubes");
+	const auto target = static_cast<size_t>(instance_count.load(std::memory_order_relaxed));
+	if (cubes.size() != target) {
+		while (cubes.size() > target) {
+			world.destroy(cubes.back());
+			cubes.pop_back();
+		}
+		while (cubes.size() < target) {
+			const auto it = static_cast<float>(cubes.size());
+			cubes.push_back(world.create(Position{}, Spin{it, it, .2f + std::fmod(it, 5.f) * .1f}, Tint{}));
+		}
+
+		// Any cube may take any cell, the query rank is used as cell index
+		const int side = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(target))));
+		const float half = static_cast<float>(side - 1) * cube_spacing / 2.f;
+		world.parallel_each_chunk<Position, Tint>("Scene3D: layout", [side, half](size_t first, Lib::Span<const Lib::Entity> entities, Lib::Span<Position> positions, Lib::Span<Tint> tints) {
+			for (size_t it = 0; it < entities.size(); it++) {
+				const auto cell_index = static_cast<int>(first + it);
+				const glm::vec3 cell(cell_index % side, (cell_index / side) % side, cell_index / (side * side));
+				positions[it].value = glm::vec3(cell.x * cube_spacing - half, cell.y * cube_spacing - half, -1.f - cell.z * cube_spacing);
+				tints[it].value = glm::vec4(cell / static_cast<float>(side), 1.);
+			}
+		});
+	}
+
+	world.parallel_each<Spin>("Scene3D: spin", [fixed_dt](Spin& spin) {
+		spin.prev_angle = spin.angle;
+		spin.angle += spin.speed * fixed_dt;
+	});
+}
+
+// Snapshot of the cubes for render()
+void Scene3D::write_cubes(std::vector<Cube>& out)
+{
+	PROFILE_SCOPE("Scene3D::write_cubes");
+	out.resize(world.count<Position, Spin, Tint>());
+	world.parallel_each_chunk<const Position, const Spin, const Tint>("Scene3D: cubes", [&out](size_t first, Lib::Span<const Lib::Entity> entities, Lib::Span<const Position> positions, Lib::Span<const Spin> spins, Lib::Span<const Tint> tints) {
+		for (size_t it = 0; it < entities.size(); it++) {
+			out[first + it] = {positions[it].value, spins[it].prev_angle, spins[it].angle, tints[it].value};
+		}
+	});
+}
+
+// Instances of the cubes between their last two updates
+void Scene3D::write_instances(const std::vector<Cube>& snapshot, float alpha)
+{
+	PROFILE_SCOPE("Scene3D::write_instances");
+	instances.resize(snapshot.size());
+	Lib::Job_system::get().parallel_for("Scene3D: instances", 0, snapshot.size(), 1024, [&](size_t from, size_t to) {
+		for (size_t it = from; it < to; it++) {
+			const Cube& cube = snapshot[it];
+			const float angle = cube.prev_angle + (cube.angle - cube.prev_angle) * alpha;
+			const glm::mat4 model = glm::translate(glm::mat4(1.), cube.position)
+			                      * glm::rotate(glm::mat4(1.), angle, glm::vec3(1, 1, 0))
+			                      * glm::scale(glm::mat4(1.), glm::vec3(cube_spacing / 2.f));
+			instances[it] = {model, cube.tint};
+		}
+	});
+}
+
+Scene3D::Scene3D(const Renderer::Static_indexed_mesh& mm):
+	renderer(Renderer::Renderer::get(Renderer::Renderer::vertex_colour)),
 	mesh(mm),
+	instanced_renderer(Renderer::Renderer::get(Renderer::Renderer::instanced | Renderer::Renderer::vertex_colour)),
 	camera()
 {
 	camera.set_perspective_projection();
-	renderer.use_program();
 	model_m4 = glm::mat4(1.);
 }
 
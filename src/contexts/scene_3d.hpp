@@ -24,14 +24,18 @@
 #include "../renderer/camera.hpp"
 #include "../renderer/renderer.hpp"
 #include "../renderer/mesh.hpp"
+#include "../lib/ecs.hpp"
+#include "../lib/triple_buffer.hpp"
 
+#include <atomic>
 #include <memory>
+#include <vector>
 
 namespace Engine::Contexts {
 
 class Scene3D : public Context {
 public:
-	Scene3D(const Renderer::Renderer& renderer, const Renderer::Static_indexed_mesh& mesh);
+	explicit Scene3D(const Renderer::Static_indexed_mesh& mesh);
 	~Scene3D() override = default;
 	Scene3D(const Scene3D&) = delete;
 	Scene3D(Scene3D&&) = delete;
@@ -39,15 +43,42 @@ public:
 	Scene3D& operator=(Scene3D&&) = delete;
 
 	void start() final;
-	void loop_run(float delta_t) final;
+	void update(float fixed_dt) final;
+	void render(float alpha) final;
+	[[nodiscard]] bool is_threadable() const final { return true; }
 private:
+	struct Cube;
+	void update_cubes(float fixed_dt);
+	void write_cubes(std::vector<Cube>& out);
+	void write_instances(const std::vector<Cube>& snapshot, float alpha);
+
 	const Renderer::Renderer& renderer;
 	const Renderer::Static_indexed_mesh& mesh;
 
+	// Instanced cubes, simulated as entities by update()
+	const Renderer::Renderer& instanced_renderer;
+	Renderer::Instance_buffer instance_buffer;
+	Lib::World world;
+	std::vector<Lib::Entity> cubes; // in creation order
+	std::atomic<int> instance_count{0}; // set by the GUI
+	std::vector<Renderer::Instance> instances; // interpolated by render()
+
 	Renderer::Camera3D camera;
 	glm::mat4 model_m4;
 
+	// Simulation state, written by update()
+	struct Cube {
+		glm::vec3 position;
+		float prev_angle, angle; // before and after the last update, for the interpolation
+		glm::vec4 tint;
+	};
+	struct State {
+		float anim_t = 0;
+		float prev_anim_t = 0; // anim_t before the last update, for the interpolation
+		std::vector<Cube> cubes;
+	};
 	float anim_t = 0;
+	Lib::Triple_buffer<State> states; // published by update(), read by render()
 
 	// GUI elements
 	static constexpr const char* prim_type_names[] = { "GL_TRIANGLES", "GL_LINE_LOOP", "GL_POINTS" };
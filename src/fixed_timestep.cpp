@@ -0,0 +1,81 @@
+/*
+    3D Physics Simulations - Fixed timestep: simulation steps decoupled from the frame rate
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "fixed_timestep.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+
+namespace Engine {
+
+Fixed_timestep::Fixed_timestep(float step, unsigned max_steps):
+		step(step), max_steps(std::max(max_steps, 1u))
+{
+}
+
+unsigned Fixed_timestep::advance(float frame_time)
+{
+	accumulator += std::max(frame_time, 0.f);
+	auto steps = static_cast<unsigned>(accumulator / step);
+	stats.dropped = 0.f;
+	if (steps > max_steps) {
+		stats.dropped = static_cast<float>((steps - max_steps) * step);
+		accumulator -= (steps - max_steps) * step;
+		steps = max_steps;
+	}
+	accumulator -= steps * step;
+	stats.steps = steps;
+	return steps;
+}
+
+void Fixed_timestep::set_step(float seconds)
+{
+	// Keeps the same fraction of a step, to not jump in the interpolation
+	accumulator = accumulator / step * seconds;
+	step = seconds;
+}
+
+void Fixed_timestep::set_max_steps(unsigned steps)
+{
+	max_steps = std::max(steps, 1u);
+}
+
+void Fixed_timestep::draw_window()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	ImGui::SetNextWindowPos(ImVec2{io.DisplaySize.x, io.DisplaySize.y * 2.f / 3.f}, ImGuiCond_FirstUseEver, ImVec2{1.f, 0.f});
+	ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Simulation", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	int rate = static_cast<int>(1. / step + .5);
+	if (ImGui::SliderInt("Steps per second", &rate, 10, 1000)) {
+		set_step(1.f / rate);
+	}
+	int max = static_cast<int>(max_steps);
+	if (ImGui::SliderInt("Max steps per frame", &max, 1, 32)) {
+		set_max_steps(max);
+	}
+	ImGui::Text("last frame: %u steps, alpha %.2f, %.1fms dropped", stats.steps, get_alpha(), stats.dropped * 1e3f);
+
+	ImGui::End();
+}
+
+} // namespace Engine
@@ -0,0 +1,62 @@
+/*
+    3D Physics Simulations - Fixed timestep: simulation steps decoupled from the frame rate
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_FIXED_TIMESTEP_HPP
+#define SIMULATION_FIXED_TIMESTEP_HPP
+
+namespace Engine {
+
+// Accumulates the frame times and tells how many steps of constant duration the simulation must advance
+// At most `max_steps` per frame: the time the simulation cannot catch up with is dropped (no spiral of death)
+// The rendering interpolates between the last two steps with `get_alpha()`
+class Fixed_timestep {
+public:
+	// Of the last frame
+	struct Stats {
+		unsigned steps = 0;
+		float dropped = 0.f; // seconds not simulated because of the clamp
+	};
+
+	explicit Fixed_timestep(float step = 1.f / 60.f, unsigned max_steps = 5);
+
+	// Adds the duration of the last frame in seconds, returns the number of steps to run
+	unsigned advance(float frame_time);
+
+	// Fraction of a step accumulated but not simulated yet, in [0, 1[
+	[[nodiscard]] float get_alpha() const { return static_cast<float>(accumulator / step); }
+	[[nodiscard]] float get_step() const { return static_cast<float>(step); }
+	[[nodiscard]] unsigned get_max_steps() const { return max_steps; }
+	[[nodiscard]] const Stats& get_stats() const { return stats; }
+
+	void set_step(float seconds);
+	void set_max_steps(unsigned steps);
+
+	// Step rate and clamp settings, call between ImGui::NewFrame and ImGui::Render
+	void draw_window();
+
+private:
+	double step;
+	double accumulator = 0.;
+	unsigned max_steps;
+	Stats stats;
+};
+
+} // namespace Engine
+
+#endif //SIMULATION_FIXED_TIMESTEP_HPP
@@ -0,0 +1,154 @@
+/*
+    3D Physics Simulations - Frame arena: bump allocator for the data of a single frame
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "frame_arena.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifndef NDEBUG
+// Replaced global allocation functions, counting the allocations of each thread
+static thread_local uint64_t thread_heap_allocations = 0;
+
+static void* counted_malloc(std::size_t size)
+{
+	thread_heap_allocations++;
+	return std::malloc(size != 0 ? size : 1);
+}
+
+void* operator new(std::size_t size)
+{
+	if (void* ptr = counted_malloc(size)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+// Over-aligned types (eg: cache line aligned), aligned_alloc requires a multiple of the alignment as size
+static void* counted_aligned_alloc(std::size_t size, std::align_val_t alignment)
+{
+	thread_heap_allocations++;
+	const auto align = static_cast<std::size_t>(alignment);
+	return std::aligned_alloc(align, size != 0 ? (size + align - 1) / align * align : align);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+	if (void* ptr = counted_aligned_alloc(size, alignment)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) { return operator new(size, alignment); }
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return counted_aligned_alloc(size, alignment); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { std::free(ptr); }
+#endif
+
+namespace Engine {
+
+uint64_t heap_allocation_count()
+{
+#ifndef NDEBUG
+	return thread_heap_allocations;
+#else
+	return 0;
+#endif
+}
+
+Frame_arena::Frame_arena(size_t capacity):
+		buffer(new std::byte[capacity]), capacity(capacity), heap_allocations_at_reset(heap_allocation_count())
+{
+	stats.capacity = capacity;
+}
+
+// Rounds `address` up to a multiple of `alignment` (a power of 2)
+static inline uintptr_t align_up(uintptr_t address, size_t alignment)
+{
+	return (address + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+void* Frame_arena::allocate(size_t bytes, size_t alignment)
+{
+	const auto base = reinterpret_cast<uintptr_t>(buffer.get());
+	const uintptr_t start = align_up(base + offset, alignment);
+	if (start + bytes <= base + capacity) {
+		offset = start + bytes - base;
+		return reinterpret_cast<void*>(start);
+	}
+
+	// Full: from the heap for this frame
+	overflow.emplace_back(new std::byte[bytes + alignment]);
+	overflow_bytes += bytes + alignment;
+	return reinterpret_cast<void*>(align_up(reinterpret_cast<uintptr_t>(overflow.back().get()), alignment));
+}
+
+void Frame_arena::reset()
+{
+	stats.used = offset + overflow_bytes;
+	stats.peak = std::max(stats.peak, stats.used);
+	stats.overflows = static_cast<unsigned>(overflow.size());
+	if (!overflow.empty()) {
+		// Fits the next frames, no need to keep the data
+		overflow.clear();
+		capacity = std::max(capacity * 2, stats.peak);
+		buffer.reset(new std::byte[capacity]);
+		stats.capacity = capacity;
+	}
+	offset = 0;
+	overflow_bytes = 0;
+
+	const uint64_t heap_allocations = heap_allocation_count();
+	stats.heap_allocations = heap_allocations - heap_allocations_at_reset;
+	heap_allocations_at_reset = heap_allocations;
+}
+
+void Frame_arena::draw_window() const
+{
+	if (ImGui::Begin("Frame stats")) {
+		ImGui::Text("frame arena: %zu KiB used, %zu KiB peak, %zu KiB capacity", stats.used / 1024, stats.peak / 1024, stats.capacity / 1024);
+#ifndef NDEBUG
+		ImGui::Text("heap allocations: %llu last frame (main thread)", static_cast<unsigned long long>(stats.heap_allocations));
+#endif
+	}
+	ImGui::End();
+}
+
+Frame_arena& Frame_arena::get()
+{
+	static Frame_arena instance(1 << 20);
+	return instance;
+}
+
+} // namespace Engine
@@ -0,0 +1,116 @@
+/*
+    3D Physics Simulations - Frame arena: bump allocator for the data of a single frame
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_FRAME_ARENA_HPP
+#define SIMULATION_FRAME_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Engine {
+
+// Heap allocations (operator new) made by the calling thread since it started, counted in debug builds only
+[[nodiscard]] uint64_t heap_allocation_count();
+
+// Linear allocator for the transient data of a frame: allocating is a pointer increment, all is released by `reset()`
+// When a frame needs more than the capacity, the extra is taken from the heap, the arena then grows on reset
+// Not thread safe: use from the thread that resets it
+class Frame_arena {
+public:
+	struct Stats {
+		size_t used = 0; // bytes, last frame
+		size_t peak = 0;
+		size_t capacity = 0;
+		unsigned overflows = 0; // heap allocations of the arena, last frame
+		uint64_t heap_allocations = 0; // by the owner thread, last frame (debug builds)
+	};
+
+	explicit Frame_arena(size_t capacity);
+	~Frame_arena() = default;
+	Frame_arena(const Frame_arena&) = delete;
+	Frame_arena(Frame_arena&&) = delete;
+	Frame_arena& operator=(const Frame_arena&) = delete;
+	Frame_arena& operator=(Frame_arena&&) = delete;
+
+	// Uninitialised storage, valid until the next reset
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+	// No destructor is ever called
+	template<typename T>
+	T* allocate(size_t count)
+	{
+		static_assert(std::is_trivially_destructible_v<T>, "Frame_arena: the destructors are not called");
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// Releases everything allocated since the last reset, and counts the heap allocations of the frame
+	void reset();
+
+	[[nodiscard]] const Stats& get_stats() const { return stats; }
+
+	// Appends the arena and allocation stats to the "Frame stats" window (see Frame_stats::draw_window)
+	void draw_window() const;
+
+	// Arena of the main thread, reset at the end of every `Main::main_loop()`
+	static Frame_arena& get();
+
+private:
+	std::unique_ptr<std::byte[]> buffer;
+	size_t capacity;
+	size_t offset = 0;
+	std::vector<std::unique_ptr<std::byte[]>> overflow; // blocks allocated when full, freed on reset
+	size_t overflow_bytes = 0;
+	uint64_t heap_allocations_at_reset;
+	Stats stats;
+};
+
+// STL allocator taking its memory from a Frame_arena, deallocating is a no-op: containers must not outlive the frame
+// Growing a container wastes its previous storage until the reset, reserve first
+template<typename T>
+class Frame_allocator {
+public:
+	using value_type = T;
+
+	Frame_allocator() noexcept: arena(&Frame_arena::get()) {};
+	explicit Frame_allocator(Frame_arena& arena) noexcept: arena(&arena) {};
+	template<typename U>
+	Frame_allocator(const Frame_allocator<U>& other) noexcept: arena(other.arena) {};
+
+	T* allocate(size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) noexcept {}
+
+	template<typename U>
+	bool operator==(const Frame_allocator<U>& other) const noexcept { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const Frame_allocator<U>& other) const noexcept { return arena != other.arena; }
+
+private:
+	template<typename U> friend class Frame_allocator;
+	Frame_arena* arena;
+};
+
+template<typename T>
+using Frame_vector = std::vector<T, Frame_allocator<T>>;
+
+} // namespace Engine
+
+#endif //SIMULATION_FRAME_ARENA_HPP
@@ -0,0 +1,133 @@
+/*
+    3D Physics Simulations - Frame stats: rolling frame time statistics
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "frame_stats.hpp"
+#include "lib/span.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+namespace Engine {
+
+constexpr unsigned histogram_buckets = 50;
+constexpr float histogram_bucket_ms = 1.f; // last bucket: anything longer
+
+void Frame_stats::record(float frame_time)
+{
+	const uint64_t head = count.load(std::memory_order_relaxed);
+	ring[head % window_size].store(frame_time, std::memory_order_relaxed);
+	count.store(head + 1, std::memory_order_release);
+	if (frame_time > get_hitch_budget()) {
+		total_hitches.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+size_t Frame_stats::copy_window(float* out) const
+{
+	const uint64_t head = count.load(std::memory_order_acquire);
+	const uint64_t first = head > window_size ? head - window_size : 0;
+	for (uint64_t it = first; it < head; it++) {
+		out[it - first] = ring[it % window_size].load(std::memory_order_relaxed);
+	}
+	return head - first;
+}
+
+// Value at `rank` (0 to 1) of the sorted `values`, by nearest rank
+static float percentile(Lib::Span<float> values, float rank)
+{
+	const size_t nth = std::min(static_cast<size_t>(std::ceil(rank * values.size())), values.size()) - 1;
+	std::nth_element(values.begin(), values.begin() + nth, values.end());
+	return values[nth];
+}
+
+Frame_stats::Summary Frame_stats::summarise() const
+{
+	std::array<float, window_size> window; // on the stack: no heap allocation, callable from any thread
+	const Lib::Span<float> values(window.data(), copy_window(window.data()));
+	Summary res;
+	res.frames = values.size();
+	if (values.empty()) {
+		return res;
+	}
+	const float budget = get_hitch_budget();
+	res.hitches = std::count_if(values.begin(), values.end(), [budget](float value) { return value > budget; });
+	res.mean = std::accumulate(values.begin(), values.end(), 0.f) / values.size();
+	res.max = *std::max_element(values.begin(), values.end());
+	res.p50 = percentile(values, .50f);
+	res.p95 = percentile(values, .95f);
+	res.p99 = percentile(values, .99f);
+	return res;
+}
+
+void Frame_stats::draw_window()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	ImGui::SetNextWindowPos(ImVec2{io.DisplaySize.x, 0.f}, ImGuiCond_FirstUseEver, ImVec2{1.f, 0.f}); // Top-Right corner
+	if (!ImGui::Begin("Frame stats", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	const Summary summary = summarise();
+	ImGui::Text("p50 %.2fms (%.0f FPS), p95 %.2fms, p99 %.2fms, max %.2fms",
+	            summary.p50 * 1e3f, summary.p50 > 0.f ? 1.f / summary.p50 : 0.f, summary.p95 * 1e3f, summary.p99 * 1e3f, summary.max * 1e3f);
+	ImGui::Text("hitches: %u in the last %u frames, %llu total", summary.hitches, summary.frames, static_cast<unsigned long long>(get_total_hitches()));
+	float budget_ms = get_hitch_budget() * 1e3f;
+	if (ImGui::SliderFloat("Hitch budget (ms)", &budget_ms, 1.f, 100.f, "%.1f")) {
+		set_hitch_budget(budget_ms / 1e3f);
+	}
+
+	// Frame times, oldest first, the hitches in red above the budget line
+	frames.resize(window_size);
+	frames.resize(copy_window(frames.data()));
+	const ImVec2 plot_size{std::max(ImGui::GetContentRegionAvail().x, 300.f), 80.f};
+	const float plot_max = std::max(summary.max, get_hitch_budget()) * 1.1f;
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	draw_list->AddRectFilled(origin, ImVec2{origin.x + plot_size.x, origin.y + plot_size.y}, ImGui::GetColorU32(ImGuiCol_FrameBg));
+	const float bar_width = plot_size.x / window_size;
+	for (size_t it = 0; it < frames.size(); it++) {
+		const float x = origin.x + it * bar_width;
+		const float height = std::min(frames[it] / plot_max, 1.f) * plot_size.y;
+		const ImU32 colour = frames[it] > get_hitch_budget() ? IM_COL32(230, 40, 40, 255) : ImGui::GetColorU32(ImGuiCol_PlotHistogram);
+		draw_list->AddRectFilled(ImVec2{x, origin.y + plot_size.y - height}, ImVec2{x + std::max(bar_width, 1.f), origin.y + plot_size.y}, colour);
+	}
+	const float budget_y = origin.y + plot_size.y * (1.f - get_hitch_budget() / plot_max);
+	draw_list->AddLine(ImVec2{origin.x, budget_y}, ImVec2{origin.x + plot_size.x, budget_y}, IM_COL32(230, 40, 40, 160));
+	ImGui::Dummy(plot_size);
+
+	// Distribution, 1ms buckets
+	histogram.assign(histogram_buckets, 0.f);
+	for (float frame: frames) {
+		histogram[std::min(static_cast<unsigned>(frame * 1e3f / histogram_bucket_ms), histogram_buckets - 1)] += 1.f;
+	}
+	ImGui::PlotHistogram("##histogram", histogram.data(), histogram.size(), 0, "frame time histogram, 0-50ms", 0.f, FLT_MAX, ImVec2{plot_size.x, 60.f});
+
+	ImGui::End();
+}
+
+Frame_stats& Frame_stats::get()
+{
+	static Frame_stats instance;
+	return instance;
+}
+
+} // namespace Engine
@@ -0,0 +1,84 @@
+/*
+    3D Physics Simulations - Frame stats: rolling frame time statistics
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_FRAME_STATS_HPP
+#define SIMULATION_FRAME_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Engine {
+
+// Frame times of the last `window_size` frames, recorded by the main loop
+// Single writer, lock-free readers: any thread may compute a summary
+class Frame_stats {
+public:
+	static constexpr unsigned window_size = 600; // 10s at 60fps
+
+	struct Summary {
+		unsigned frames = 0; // in the window
+		float p50 = 0.f, p95 = 0.f, p99 = 0.f, max = 0.f; // seconds
+		float mean = 0.f;
+		unsigned hitches = 0; // frames over the budget, in the window
+	};
+
+	// Records the duration of the last frame, in seconds (main thread)
+	void record(float frame_time);
+
+	// Percentiles of the frames in the window
+	[[nodiscard]] Summary summarise() const;
+
+	// Frames longer than `budget` seconds are hitches
+	void set_hitch_budget(float budget) { hitch_budget.store(budget, std::memory_order_relaxed); }
+	[[nodiscard]] float get_hitch_budget() const { return hitch_budget.load(std::memory_order_relaxed); }
+	[[nodiscard]] uint64_t get_total_hitches() const { return total_hitches.load(std::memory_order_relaxed); }
+
+	// Statistics, frame time plot with the hitches, and histogram, call between ImGui::NewFrame and ImGui::Render
+	void draw_window();
+
+	// Lazy initialised singleton
+	static Frame_stats& get();
+
+private:
+	Frame_stats() = default;
+	~Frame_stats() = default;
+	Frame_stats(const Frame_stats&) = delete;
+	Frame_stats(Frame_stats&&) = delete;
+	Frame_stats& operator=(const Frame_stats&) = delete;
+	Frame_stats& operator=(Frame_stats&&) = delete;
+
+	// Copies the frame times of the window into `out` (room for window_size values), oldest first, returns their count
+	size_t copy_window(float* out) const;
+
+	std::array<std::atomic<float>, window_size> ring{};
+	std::atomic<uint64_t> count{0}; // frames ever recorded, published with release semantics
+	std::atomic<float> hitch_budget{1.5f / 60.f};
+	std::atomic<uint64_t> total_hitches{0};
+
+	// UI (main thread)
+	std::vector<float> frames;
+	std::vector<float> histogram;
+};
+
+} // namespace Engine
+
+#endif //SIMULATION_FRAME_STATS_HPP
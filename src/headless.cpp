@@ -0,0 +1,170 @@
+/*
+    3D Physics Simulations - Headless: offscreen EGL context rendering into a framebuffer object
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "headless.hpp"
+
+#ifdef WITH_HEADLESS
+
+#include "error.hpp"
+
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <string>
+
+using std::literals::string_literals::operator""s;
+
+namespace Engine {
+
+// Whether `name` is in the space separated list of `extensions`
+static bool has_extension(const char* extensions, const char* name)
+{
+	if (extensions == nullptr) {
+		return false;
+	}
+	const size_t length = std::strlen(name);
+	for (const char* it = std::strstr(extensions, name); it != nullptr; it = std::strstr(it + length, name)) {
+		if ((it == extensions || it[-1] == ' ') && (it[length] == ' ' || it[length] == '\0')) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static EGLDisplay get_display()
+{
+	// Querying the client extensions requires EGL_EXT_client_extensions, returns NULL otherwise
+	const char* client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if (has_extension(client_extensions, "EGL_MESA_platform_surfaceless")) {
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+		if (get_platform_display != nullptr) {
+			EGLDisplay display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (display != EGL_NO_DISPLAY) {
+				return display;
+			}
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+Headless_display::Headless_display(int width, int height, bool debug_context): width(width), height(height)
+{
+	display = get_display();
+	EGLint major, minor;
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+		display = EGL_NO_DISPLAY;
+		throw Error("EGL: cannot initialise");
+	}
+	const bool surfaceless = has_extension(eglQueryString(display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(display, config_attribs, &config, 1, &config_count) || config_count == 0) {
+		destroy();
+		throw Error("EGL: no GL ES3 config");
+	}
+
+	if (!eglBindAPI(EGL_OPENGL_ES_API)) {
+		destroy();
+		throw Error("EGL: cannot bind the GL ES API");
+	}
+	// EGL_CONTEXT_OPENGL_DEBUG requires EGL 1.5
+	const bool debug = debug_context && (major > 1 || minor >= 5);
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 0,
+		debug ? EGL_CONTEXT_OPENGL_DEBUG : EGL_NONE, EGL_TRUE, // terminates the list early if not debug
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+	if (context == EGL_NO_CONTEXT) {
+		destroy();
+		throw Error("EGL: cannot create a GL ES3 context");
+	}
+
+	// Nothing is rendered to the pbuffer, its size does not matter
+	if (!surfaceless) {
+		const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+		if (surface == EGL_NO_SURFACE) {
+			destroy();
+			throw Error("EGL: cannot create a pbuffer surface");
+		}
+	}
+	if (!eglMakeCurrent(display, surface, surface, context)) {
+		destroy();
+		throw Error("EGL: cannot make the context current");
+	}
+
+	glGenRenderbuffers(1, &colour_renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colour_renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depth_renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, GL_NONE);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colour_renderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		destroy();
+		throw Error("GL: incomplete headless framebuffer, status "s + std::to_string(status));
+	}
+}
+
+Headless_display::~Headless_display()
+{
+	destroy();
+}
+
+void Headless_display::destroy()
+{
+	if (framebuffer != GL_NONE) {
+		glBindFramebuffer(GL_FRAMEBUFFER, GL_NONE);
+		glDeleteFramebuffers(1, &framebuffer);
+		glDeleteRenderbuffers(1, &colour_renderbuffer);
+		glDeleteRenderbuffers(1, &depth_renderbuffer);
+		framebuffer = colour_renderbuffer = depth_renderbuffer = GL_NONE;
+	}
+	if (display == EGL_NO_DISPLAY) {
+		return;
+	}
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (surface != EGL_NO_SURFACE) {
+		eglDestroySurface(display, surface);
+	}
+	if (context != EGL_NO_CONTEXT) {
+		eglDestroyContext(display, context);
+	}
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+}
+
+} // namespace Engine
+
+#endif // WITH_HEADLESS
@@ -0,0 +1,80 @@
+/*
+    3D Physics Simulations - Headless: offscreen EGL context rendering into a framebuffer object
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_HEADLESS_HPP
+#define SIMULATION_HEADLESS_HPP
+
+#ifdef WITH_HEADLESS
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+
+namespace Engine {
+
+// Offscreen GL ES3 context for machines without a display (eg: render nodes, CI), no vsync throttling
+// Uses the Mesa surfaceless platform if available, a pbuffer on the default display otherwise
+// Everything is rendered into a framebuffer object, kept bound for the whole lifetime of the display
+// throws an Engine::Error on failure
+class Headless_display {
+public:
+	Headless_display(int width, int height, bool debug_context);
+	~Headless_display();
+
+	// Name of the framebuffer object rendered to
+	[[nodiscard]] GLuint get_framebuffer() const { return framebuffer; }
+	[[nodiscard]] int get_width() const { return width; }
+	[[nodiscard]] int get_height() const { return height; }
+
+	Headless_display(const Headless_display&) = delete;
+	Headless_display(Headless_display&&) = delete;
+	Headless_display& operator=(const Headless_display&) = delete;
+	Headless_display& operator=(Headless_display&&) = delete;
+
+private:
+	void destroy(); // releases whatever was created, also on construction failure
+
+	int width;
+	int height;
+
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE; // stays EGL_NO_SURFACE with EGL_KHR_surfaceless_context
+	EGLContext context = EGL_NO_CONTEXT;
+
+	GLuint framebuffer = GL_NONE;
+	GLuint colour_renderbuffer = GL_NONE;
+	GLuint depth_renderbuffer = GL_NONE;
+};
+
+} // namespace Engine
+
+#else
+
+namespace Engine {
+
+// Not available in this build, never constructed
+class Headless_display {
+public:
+	[[nodiscard]] unsigned get_framebuffer() const { return 0; }
+};
+
+} // namespace Engine
+
+#endif // WITH_HEADLESS
+
+#endif //SIMULATION_HEADLESS_HPP
@@ -0,0 +1,204 @@
+/*
+    3D Physics Simulations - ECS: archetype-based entity component system, components stored in SoA chunks
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "ecs.hpp"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace Lib {
+
+namespace {
+
+struct Component_info {
+	size_t size;
+	size_t alignment;
+};
+
+// Component types of every World, by id
+struct Component_registry {
+	std::mutex mutex;
+	std::vector<Component_info> components;
+
+	static Component_registry& get()
+	{
+		static Component_registry instance;
+		return instance;
+	}
+};
+
+} // namespace
+
+unsigned World::register_component(size_t size, size_t alignment)
+{
+	Component_registry& registry = Component_registry::get();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	if (registry.components.size() >= max_components) {
+		throw std::logic_error("World: too many component types");
+	}
+	registry.components.push_back({size, alignment});
+	return static_cast<unsigned>(registry.components.size() - 1);
+}
+
+bool World::is_alive(Entity entity) const
+{
+	return entity.index < slots.size() && slots[entity.index].generation == entity.generation && slots[entity.index].archetype != nullptr;
+}
+
+bool World::destroy(Entity entity)
+{
+	check_structural_change("World::destroy");
+	if (!is_alive(entity)) {
+		return false;
+	}
+	Slot& slot = slots[entity.index];
+	remove_row(*slot.archetype, slot.chunk, slot.row);
+	slot.archetype = nullptr;
+	if (++slot.generation == 0) {
+		slot.generation = 1; // 0 is the null handle
+	}
+	free_slots.push_back(entity.index);
+	live_count--;
+	return true;
+}
+
+void World::check_structural_change(const char* what) const
+{
+	if (iterating > 0) {
+		throw std::logic_error(std::string(what) + ": structural change during a query");
+	}
+}
+
+World::Slot& World::checked_slot(Entity entity, const char* what)
+{
+	if (!is_alive(entity)) {
+		throw std::logic_error(std::string(what) + ": stale entity");
+	}
+	return slots[entity.index];
+}
+
+World::Archetype& World::archetype(Mask mask)
+{
+	auto found = archetype_by_mask.find(mask);
+	if (found != archetype_by_mask.end()) {
+		return *found->second;
+	}
+
+	auto created = std::make_unique<Archetype>();
+	created->mask = mask;
+	{
+		Component_registry& registry = Component_registry::get();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		for (unsigned id = 0; id < max_components; id++) {
+			if ((mask & (Mask(1) << id)) != 0) {
+				const Component_info& info = registry.components[id];
+				created->columns.push_back({id, 0, static_cast<uint32_t>(info.size), static_cast<uint32_t>(info.alignment)});
+			}
+		}
+	}
+
+	// Rows per chunk, leaving room for the padding between the arrays
+	size_t row_size = sizeof(Entity);
+	size_t padding = 0;
+	for (const Column& column: created->columns) {
+		row_size += column.size;
+		padding += column.alignment - 1;
+	}
+	if (chunk_size < padding + row_size) {
+		throw std::logic_error("World: components too large for a chunk");
+	}
+	created->capacity = static_cast<uint32_t>((chunk_size - padding) / row_size);
+
+	size_t offset = created->capacity * sizeof(Entity);
+	for (Column& column: created->columns) {
+		offset = (offset + column.alignment - 1) / column.alignment * column.alignment;
+		column.offset = static_cast<uint32_t>(offset);
+		created->offsets[column.id] = column.offset;
+		offset += created->capacity * column.size;
+	}
+
+	Archetype& result = *created;
+	archetype_by_mask.emplace(mask, &result);
+	archetypes.push_back(std::move(created));
+	return result;
+}
+
+void World::push(Archetype& archetype, Entity entity)
+{
+	if (archetype.chunks.empty() || archetype.chunks.back().count == archetype.capacity) {
+		Chunk chunk;
+		chunk.storage = archetype.spare ? std::move(archetype.spare) : std::make_unique<Chunk_storage>();
+		archetype.chunks.push_back(std::move(chunk));
+	}
+	Chunk& chunk = archetype.chunks.back();
+	const uint32_t row = chunk.count++;
+	entities(chunk)[row] = entity;
+	archetype.size++;
+
+	Slot& slot = slots[entity.index];
+	slot.archetype = &archetype;
+	slot.chunk = static_cast<uint32_t>(archetype.chunks.size() - 1);
+	slot.row = row;
+}
+
+void World::remove_row(Archetype& archetype, uint32_t chunk, uint32_t row)
+{
+	Chunk& last = archetype.chunks.back();
+	const uint32_t last_row = last.count - 1;
+	if (&archetype.chunks[chunk] != &last || row != last_row) {
+		// Fills the hole with the last entity of the archetype
+		Chunk& hole = archetype.chunks[chunk];
+		const Entity moved = entities(last)[last_row];
+		entities(hole)[row] = moved;
+		for (const Column& column: archetype.columns) {
+			std::memcpy(hole.storage->bytes + column.offset + row * column.size,
+			            last.storage->bytes + column.offset + last_row * column.size, column.size);
+		}
+		slots[moved.index].chunk = chunk;
+		slots[moved.index].row = row;
+	}
+
+	last.count--;
+	archetype.size--;
+	if (last.count == 0) {
+		archetype.spare = std::move(last.storage);
+		archetype.chunks.pop_back();
+	}
+}
+
+void World::move(Entity entity, Archetype& to)
+{
+	Slot& slot = slots[entity.index];
+	Archetype& from = *slot.archetype;
+	const uint32_t from_chunk = slot.chunk;
+	const uint32_t from_row = slot.row;
+
+	push(to, entity);
+	const Chunk& source = from.chunks[from_chunk];
+	const Chunk& destination = to.chunks[slot.chunk];
+	for (const Column& column: to.columns) {
+		const uint32_t source_offset = from.offsets[column.id];
+		if (source_offset != 0) {
+			std::memcpy(destination.storage->bytes + column.offset + slot.row * column.size,
+			            source.storage->bytes + source_offset + from_row * column.size, column.size);
+		}
+	}
+	remove_row(from, from_chunk, from_row);
+}
+
+} // namespace Lib
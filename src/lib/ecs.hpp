@@ -0,0 +1,378 @@
+/*
+    3D Physics Simulations - ECS: archetype-based entity component system, components stored in SoA chunks
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef LIB_ECS_HPP
+#define LIB_ECS_HPP
+
+#include "job_system.hpp"
+#include "span.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace Lib {
+
+// Handle to an entity of a World, stale once the entity is destroyed (its slot is then reused with another generation)
+struct Entity {
+	uint32_t index = 0;
+	uint32_t generation = 0; // 0: null handle
+
+	[[nodiscard]] bool is_null() const { return generation == 0; }
+	bool operator==(const Entity& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const Entity& other) const { return !(*this == other); }
+};
+
+// Entities made of components, plain data types identified by their C++ type
+// Entities with the same set of components (an archetype) are packed in fixed size chunks, one array per component (SoA),
+// queries run over the chunks of every archetype having the requested components
+// Not thread safe: structural changes (create, destroy, add, remove) and queries are done by one thread at a time,
+// parallel queries hand distinct chunks to the job system, structural changes then throw a logic_error
+class World {
+public:
+	using Mask = uint64_t; // bit N: has component N
+	static constexpr unsigned max_components = 64;
+	static constexpr size_t chunk_size = 16 << 10; // bytes, fits in L1 caches
+	static constexpr size_t chunk_alignment = 64; // a cache line, the maximum alignment of components
+
+	World() = default;
+	~World() = default;
+	World(const World&) = delete;
+	World(World&&) = delete;
+	World& operator=(const World&) = delete;
+	World& operator=(World&&) = delete;
+
+	template<typename... Ts>
+	Entity create(const Ts&... components);
+	// Returns false if the handle is stale
+	bool destroy(Entity entity);
+	[[nodiscard]] bool is_alive(Entity entity) const;
+	[[nodiscard]] size_t size() const { return live_count; }
+
+	// Moves the entity to the archetype with (without) the component, sets it if the entity already has it
+	// throw a logic_error if the handle is stale
+	template<typename T>
+	void add(Entity entity, const T& component);
+	template<typename T>
+	void remove(Entity entity);
+
+	// nullptr if the handle is stale or the entity does not have the component
+	// valid until the next structural change
+	template<typename T>
+	[[nodiscard]] T* get(Entity entity);
+	template<typename T>
+	[[nodiscard]] bool has(Entity entity) const { return get_const<T>(entity) != nullptr; }
+
+	// Number of entities having at least the components Ts
+	template<typename... Ts>
+	[[nodiscard]] size_t count() const;
+
+	// Calls `function(first, Span<const Entity>, Span<Ts>...)` on each chunk of entities having at least the components Ts,
+	// Ts may be const, `first` is the rank of the first entity of the chunk in the query (for dense outputs, see count())
+	// Archetypes and chunks are visited in a stable order, swap-removals reorder the entities of a chunk
+	template<typename... Ts, typename F>
+	void each_chunk(F&& function);
+
+	// Calls `function(Ts&...)` on each entity having at least the components Ts
+	template<typename... Ts, typename F>
+	void each(F&& function);
+
+	// Same as each_chunk() and each(), the chunks are processed in parallel by Job_system::get()
+	template<typename... Ts, typename F>
+	void parallel_each_chunk(const char* name, F&& function);
+	template<typename... Ts, typename F>
+	void parallel_each(const char* name, F&& function);
+
+	// Component identifier, assigned on first use (shared by every World)
+	// throws a logic_error past max_components types
+	template<typename T>
+	static unsigned component_id();
+
+private:
+	struct alignas(chunk_alignment) Chunk_storage {
+		std::byte bytes[chunk_size];
+	};
+
+	struct Chunk {
+		std::unique_ptr<Chunk_storage> storage;
+		uint32_t count = 0;
+	};
+
+	struct Column {
+		unsigned id;
+		uint32_t offset; // in the chunks
+		uint32_t size; // of a component
+		uint32_t alignment;
+	};
+
+	// Entities with the same set of components, the entity handles are the first array of each chunk
+	struct Archetype {
+		Mask mask = 0;
+		std::vector<Column> columns; // by ascending component id
+		std::array<uint32_t, max_components> offsets{}; // by component id, 0: not in the archetype
+		uint32_t capacity = 0; // entities per chunk
+		std::vector<Chunk> chunks; // full but the last one
+		std::unique_ptr<Chunk_storage> spare; // last released chunk, reused by the next push
+		size_t size = 0;
+	};
+
+	// Where an entity is stored, `archetype` is nullptr for free slots
+	struct Slot {
+		uint32_t generation = 1;
+		Archetype* archetype = nullptr;
+		uint32_t chunk = 0;
+		uint32_t row = 0;
+	};
+
+	struct Query_chunk {
+		Chunk* chunk;
+		const Archetype* archetype;
+		size_t first;
+	};
+
+	// Forbids structural changes while iterating
+	class Iteration_scope {
+	public:
+		explicit Iteration_scope(World& world): world(world) { world.iterating++; };
+		~Iteration_scope() { world.iterating--; };
+		Iteration_scope(const Iteration_scope&) = delete;
+		Iteration_scope(Iteration_scope&&) = delete;
+		Iteration_scope& operator=(const Iteration_scope&) = delete;
+		Iteration_scope& operator=(Iteration_scope&&) = delete;
+	private:
+		World& world;
+	};
+
+	template<typename... Ts>
+	struct Distinct: std::true_type {};
+	template<typename T, typename... Ts>
+	struct Distinct<T, Ts...>: std::bool_constant<(!std::is_same_v<T, Ts> && ...) && Distinct<Ts...>::value> {};
+
+	static unsigned register_component(size_t size, size_t alignment);
+
+	template<typename... Ts>
+	static Mask mask_of() { return (Mask(0) | ... | (Mask(1) << component_id<std::remove_cv_t<Ts>>())); }
+
+	template<typename T>
+	static T* column(const Archetype& archetype, const Chunk& chunk)
+	{
+		return reinterpret_cast<T*>(chunk.storage->bytes + archetype.offsets[component_id<std::remove_cv_t<T>>()]);
+	}
+
+	static Entity* entities(const Chunk& chunk) { return reinterpret_cast<Entity*>(chunk.storage->bytes); }
+
+	void check_structural_change(const char* what) const;
+	Slot& checked_slot(Entity entity, const char* what);
+	Archetype& archetype(Mask mask);
+	// Appends the entity to the archetype, updates its slot
+	void push(Archetype& archetype, Entity entity);
+	// Swap-removes a row, updates the slot of the moved entity
+	void remove_row(Archetype& archetype, uint32_t chunk, uint32_t row);
+	// Moves an entity and the components both archetypes have
+	void move(Entity entity, Archetype& to);
+
+	template<typename T>
+	const T* get_const(Entity entity) const;
+
+	std::vector<std::unique_ptr<Archetype>> archetypes; // in creation order, the order of the queries
+	std::unordered_map<Mask, Archetype*> archetype_by_mask;
+
+	std::vector<Slot> slots; // by entity index
+	std::vector<uint32_t> free_slots;
+	size_t live_count = 0;
+
+	unsigned iterating = 0; // nested queries
+	std::vector<Query_chunk> query_chunks; // of the running parallel query, reused
+	bool parallel_query = false;
+};
+
+template<typename T>
+unsigned World::component_id()
+{
+	static_assert(std::is_same_v<T, std::remove_cv_t<T>>, "World: components are identified without cv-qualifiers");
+	static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>, "World: components are plain data, moved with memcpy");
+	static_assert(alignof(T) <= chunk_alignment, "World: over-aligned component");
+	static const unsigned id = register_component(sizeof(T), alignof(T));
+	return id;
+}
+
+template<typename... Ts>
+Entity World::create(const Ts&... components)
+{
+	static_assert(Distinct<Ts...>::value, "World::create: duplicate component type");
+	check_structural_change("World::create");
+	Archetype& target = archetype(mask_of<Ts...>());
+
+	uint32_t index;
+	if (!free_slots.empty()) {
+		index = free_slots.back();
+		free_slots.pop_back();
+	}
+	else {
+		index = static_cast<uint32_t>(slots.size());
+		slots.emplace_back();
+	}
+	const Entity entity{index, slots[index].generation};
+	push(target, entity);
+	live_count++;
+
+	const Slot& slot = slots[index];
+	const Chunk& chunk = target.chunks[slot.chunk];
+	(new (column<Ts>(target, chunk) + slot.row) Ts(components), ...);
+	return entity;
+}
+
+template<typename T>
+void World::add(Entity entity, const T& component)
+{
+	check_structural_change("World::add");
+	const Mask bit = Mask(1) << component_id<T>();
+	Slot& slot = checked_slot(entity, "World::add");
+	if ((slot.archetype->mask & bit) == 0) {
+		move(entity, archetype(slot.archetype->mask | bit));
+	}
+	const Chunk& chunk = slot.archetype->chunks[slot.chunk];
+	new (column<T>(*slot.archetype, chunk) + slot.row) T(component);
+}
+
+template<typename T>
+void World::remove(Entity entity)
+{
+	check_structural_change("World::remove");
+	const Mask bit = Mask(1) << component_id<T>();
+	Slot& slot = checked_slot(entity, "World::remove");
+	if ((slot.archetype->mask & bit) != 0) {
+		move(entity, archetype(slot.archetype->mask & ~bit));
+	}
+}
+
+template<typename T>
+const T* World::get_const(Entity entity) const
+{
+	if (!is_alive(entity)) {
+		return nullptr;
+	}
+	const Slot& slot = slots[entity.index];
+	if (slot.archetype->offsets[component_id<std::remove_cv_t<T>>()] == 0) {
+		return nullptr;
+	}
+	return column<const T>(*slot.archetype, slot.archetype->chunks[slot.chunk]) + slot.row;
+}
+
+template<typename T>
+T* World::get(Entity entity)
+{
+	return const_cast<T*>(get_const<T>(entity));
+}
+
+template<typename... Ts>
+size_t World::count() const
+{
+	const Mask mask = mask_of<Ts...>();
+	size_t result = 0;
+	for (const auto& archetype: archetypes) {
+		if ((archetype->mask & mask) == mask) {
+			result += archetype->size;
+		}
+	}
+	return result;
+}
+
+template<typename... Ts, typename F>
+void World::each_chunk(F&& function)
+{
+	const Mask mask = mask_of<Ts...>();
+	Iteration_scope scope(*this);
+	size_t first = 0;
+	for (const auto& archetype: archetypes) {
+		if ((archetype->mask & mask) != mask) {
+			continue;
+		}
+		for (const Chunk& chunk: archetype->chunks) {
+			function(first, Span<const Entity>(entities(chunk), chunk.count), Span<Ts>(column<Ts>(*archetype, chunk), chunk.count)...);
+			first += chunk.count;
+		}
+	}
+}
+
+template<typename... Ts, typename F>
+void World::each(F&& function)
+{
+	each_chunk<Ts...>([&function](size_t, Span<const Entity> entities, Span<Ts>... columns) {
+		for (size_t it = 0; it < entities.size(); it++) {
+			function(columns[it]...);
+		}
+	});
+}
+
+template<typename... Ts, typename F>
+void World::parallel_each_chunk(const char* name, F&& function)
+{
+	if (parallel_query) {
+		throw std::logic_error("World::parallel_each_chunk: nested parallel query");
+	}
+	const Mask mask = mask_of<Ts...>();
+	Iteration_scope scope(*this);
+
+	query_chunks.clear();
+	size_t first = 0;
+	for (const auto& archetype: archetypes) {
+		if ((archetype->mask & mask) != mask) {
+			continue;
+		}
+		for (Chunk& chunk: archetype->chunks) {
+			query_chunks.push_back({&chunk, archetype.get(), first});
+			first += chunk.count;
+		}
+	}
+
+	parallel_query = true;
+	struct Reset {
+		bool& flag;
+		~Reset() { flag = false; }
+	} reset{parallel_query};
+	// A chunk per job: its components fill a few pages, enough work to amortise the scheduling
+	Job_system::get().parallel_for(name, 0, query_chunks.size(), 1, [this, &function](size_t from, size_t to) {
+		for (size_t it = from; it < to; it++) {
+			const Query_chunk& query = query_chunks[it];
+			const Chunk& chunk = *query.chunk;
+			function(query.first, Span<const Entity>(entities(chunk), chunk.count), Span<Ts>(column<Ts>(*query.archetype, chunk), chunk.count)...);
+		}
+	});
+}
+
+template<typename... Ts, typename F>
+void World::parallel_each(const char* name, F&& function)
+{
+	parallel_each_chunk<Ts...>(name, [&function](size_t, Span<const Entity> entities, Span<Ts>... columns) {
+		for (size_t it = 0; it < entities.size(); it++) {
+			function(columns[it]...);
+		}
+	});
+}
+
+} // namespace Lib
+
+#endif //LIB_ECS_HPP
@@ -0,0 +1,320 @@
+/*
+    3D Physics Simulations - Job system: work-stealing scheduler for fork-join and parallel loops
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "job_system.hpp"
+
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Lib {
+
+// Chase-Lev deque (fixed capacity), with sequentially consistent accesses instead of the fences of
+// Lê, Pop, Cohen & Zappa Nardelli (PPoPP 2013): as fast on x86, and understood by ThreadSanitizer
+// The owner pushes and pops at the bottom (LIFO, cache friendly), thieves steal from the top (FIFO, large tasks first)
+class Job_system::Worker {
+public:
+	static constexpr int64_t capacity = 4096; // a power of 2
+
+	Worker(Job_system& owner, unsigned index): owner(owner), index(index), buffer(new std::atomic<Job*>[capacity]) {};
+
+	// Owner thread only, returns false when full
+	bool push(Job* job)
+	{
+		const int64_t b = bottom.load(std::memory_order_relaxed);
+		const int64_t t = top.load(std::memory_order_acquire);
+		if (b - t >= capacity) {
+			return false;
+		}
+		buffer[b & (capacity - 1)].store(job, std::memory_order_relaxed);
+		bottom.store(b + 1, std::memory_order_release); // publishes the job
+		return true;
+	}
+
+	// Owner thread only
+	Job* pop()
+	{
+		// Sequentially consistent: the thieves must see the bottom reserved before this reads the top
+		const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+		bottom.store(b, std::memory_order_seq_cst);
+		int64_t t = top.load(std::memory_order_seq_cst);
+		if (t > b) { // empty
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return nullptr;
+		}
+		Job* job = buffer[b & (capacity - 1)].load(std::memory_order_relaxed);
+		if (t == b) { // last one, races with the thieves
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				job = nullptr;
+			}
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+		return job;
+	}
+
+	// Any thread
+	Job* steal()
+	{
+		int64_t t = top.load(std::memory_order_seq_cst);
+		const int64_t b = bottom.load(std::memory_order_seq_cst);
+		if (t >= b) {
+			return nullptr;
+		}
+		Job* job = buffer[t & (capacity - 1)].load(std::memory_order_relaxed);
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+			return nullptr; // lost the race
+		}
+		return job;
+	}
+
+	Job_system& owner;
+	const unsigned index;
+	std::thread thread;
+
+private:
+	alignas(64) std::atomic<int64_t> top{0};
+	alignas(64) std::atomic<int64_t> bottom{0};
+	std::unique_ptr<std::atomic<Job*>[]> buffer;
+};
+
+namespace {
+
+constexpr size_t pool_size = 1024; // jobs per thread in flight before recycling, a power of 2
+
+// Jobs allocated by a thread, recycled in order
+struct Job_pool {
+	std::unique_ptr<Job_system::Job[]> jobs{new Job_system::Job[pool_size]};
+	size_t next = 0;
+};
+
+// xorshift, picks the victims
+thread_local uint32_t steal_seed = 0;
+
+Job_system::Config shared_config;
+std::atomic<bool> shared_started{false};
+
+} // namespace
+
+thread_local Job_system::Worker* Job_system::current_worker = nullptr;
+
+unsigned Job_system::default_workers()
+{
+#ifdef EMSCRIPTEN
+	return 0;
+#else
+	const unsigned cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 0;
+#endif
+}
+
+Job_system::Job_system(const Config& config): hooks(config.hooks)
+{
+	workers.reserve(config.workers);
+	for (unsigned it = 0; it < config.workers; it++) {
+		workers.push_back(std::make_unique<Worker>(*this, it));
+	}
+	// Started once all the deques exist, to be stolen from
+	for (std::unique_ptr<Worker>& worker: workers) {
+		worker->thread = std::thread(&Job_system::worker_main, this, worker->index);
+#ifdef __linux__
+		if (config.pin_workers) {
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET((worker->index + 1) % std::max(std::thread::hardware_concurrency(), 1u), &cpus);
+			pthread_setaffinity_np(worker->thread.native_handle(), sizeof(cpus), &cpus);
+		}
+#endif
+	}
+}
+
+Job_system::~Job_system()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		quit.store(true);
+	}
+	wake.notify_all();
+	for (std::unique_ptr<Worker>& worker: workers) {
+		worker->thread.join();
+	}
+}
+
+void Job_system::configure(const Config& config)
+{
+	if (shared_started.load()) {
+		throw std::logic_error("Job_system: configured after first use");
+	}
+	shared_config = config;
+}
+
+Job_system& Job_system::get()
+{
+	static Job_system instance((shared_started.store(true), shared_config));
+	return instance;
+}
+
+void Job_system::wait(const Job_counter& counter)
+{
+	while (!counter.is_done()) {
+		if (Job* job = find_job()) {
+			execute(job);
+		}
+		else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+Job_system::Job* Job_system::allocate()
+{
+	thread_local Job_pool pool;
+	Job& job = pool.jobs[pool.next++ & (pool_size - 1)];
+	// Still queued or running (maybe up the stack, waiting), too many jobs in flight
+	if (job.busy.load(std::memory_order_acquire)) {
+		Job* allocated = new Job;
+		allocated->pooled = false;
+		return allocated;
+	}
+	job.busy.store(true, std::memory_order_relaxed);
+	return &job;
+}
+
+void Job_system::submit(Job* job)
+{
+	if (current_worker != nullptr && &current_worker->owner == this) {
+		if (!current_worker->push(job)) {
+			execute(job); // deque full
+			return;
+		}
+	}
+	else {
+		std::lock_guard<std::mutex> lock(injected_mutex);
+		injected.push_back(job);
+		injected_count.fetch_add(1, std::memory_order_release);
+	}
+
+	spawned.fetch_add(1, std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_seq_cst) > 0) {
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		wake.notify_one();
+	}
+}
+
+Job_system::Job* Job_system::find_job()
+{
+	Worker* self = current_worker != nullptr && &current_worker->owner == this ? current_worker : nullptr;
+	if (self != nullptr) {
+		if (Job* job = self->pop()) {
+			return job;
+		}
+	}
+
+	if (injected_count.load(std::memory_order_acquire) > 0) {
+		std::lock_guard<std::mutex> lock(injected_mutex);
+		if (injected_head < injected.size()) {
+			Job* job = injected[injected_head++];
+			if (injected_head == injected.size()) {
+				injected.clear();
+				injected_head = 0;
+			}
+			injected_count.fetch_sub(1, std::memory_order_relaxed);
+			return job;
+		}
+	}
+
+	const auto count = static_cast<uint32_t>(workers.size());
+	if (count == 0) {
+		return nullptr;
+	}
+	if (steal_seed == 0) {
+		steal_seed = static_cast<uint32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) | 1u;
+	}
+	steal_seed ^= steal_seed << 13;
+	steal_seed ^= steal_seed >> 17;
+	steal_seed ^= steal_seed << 5;
+	for (uint32_t it = 0, first = steal_seed % count; it < count; it++) {
+		Worker& victim = *workers[(first + it) % count];
+		if (&victim == self) {
+			continue;
+		}
+		if (Job* job = victim.steal()) {
+			return job;
+		}
+	}
+	return nullptr;
+}
+
+void Job_system::execute(Job* job)
+{
+	if (hooks.job != nullptr) {
+		hooks.job(job->name, [](void* self) { static_cast<Job*>(self)->run(*static_cast<Job*>(self)); }, job);
+	}
+	else {
+		job->run(*job);
+	}
+	// The job may be reused, and the counter deleted, right after these
+	Job_counter* counter = job->counter;
+	if (job->pooled) {
+		job->busy.store(false, std::memory_order_release);
+	}
+	else {
+		delete job;
+	}
+	counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void Job_system::worker_main(unsigned index)
+{
+	current_worker = workers[index].get();
+	if (hooks.worker_start != nullptr) {
+		hooks.worker_start(index);
+	}
+
+	constexpr unsigned spin_rounds = 64; // before sleeping
+	unsigned idle = 0;
+	while (!quit.load(std::memory_order_relaxed)) {
+		// Read before searching: a job submitted after the search changes it, so it is not slept through
+		const uint64_t seen = spawned.load(std::memory_order_seq_cst);
+		if (Job* job = find_job()) {
+			execute(job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < spin_rounds) {
+			std::this_thread::yield();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleeping.fetch_add(1, std::memory_order_seq_cst);
+		wake.wait(lock, [&]() { return quit.load() || spawned.load(std::memory_order_seq_cst) != seen; });
+		sleeping.fetch_sub(1, std::memory_order_relaxed);
+		idle = 0;
+	}
+}
+
+size_t Job_system::auto_grain(size_t count) const
+{
+	// A few ranges per thread, for the stealing to balance uneven loads
+	return std::max<size_t>(count / ((workers.size() + 1) * 4), 1);
+}
+
+} // namespace Lib
@@ -0,0 +1,222 @@
+/*
+    3D Physics Simulations - Job system: work-stealing scheduler for fork-join and parallel loops
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef LIB_JOB_SYSTEM_HPP
+#define LIB_JOB_SYSTEM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Lib {
+
+// Counts the unfinished jobs spawned with it, see `Job_system::wait()`
+class Job_counter {
+public:
+	Job_counter() = default;
+	~Job_counter() = default;
+	Job_counter(const Job_counter&) = delete;
+	Job_counter(Job_counter&&) = delete;
+	Job_counter& operator=(const Job_counter&) = delete;
+	Job_counter& operator=(Job_counter&&) = delete;
+
+	[[nodiscard]] bool is_done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class Job_system;
+	std::atomic<uint32_t> pending{0};
+};
+
+// Thread pool running small jobs, each worker has its own deque (Chase-Lev) and steals from the others when empty
+// Jobs may spawn and wait for other jobs (fork/join): the waiting thread runs queued jobs meanwhile
+// Jobs must not throw
+class Job_system {
+public:
+	struct Hooks {
+		// Called on each worker thread when it starts, eg: to name it in a profiler
+		void (*worker_start)(unsigned index) = nullptr;
+		// Runs every job, must call `run(job)`, eg: within a profiler scope named `name`
+		void (*job)(const char* name, void (*run)(void* job), void* job) = nullptr;
+	};
+
+	struct Config {
+		unsigned workers = default_workers(); // besides the calling threads, 0 to run the jobs in `wait()` only
+		bool pin_workers = false; // runs worker N on CPU N+1 only (Linux)
+		Hooks hooks;
+	};
+
+	explicit Job_system(const Config& config);
+	~Job_system(); // all the jobs must have been waited for
+	Job_system(const Job_system&) = delete;
+	Job_system(Job_system&&) = delete;
+	Job_system& operator=(const Job_system&) = delete;
+	Job_system& operator=(Job_system&&) = delete;
+
+	// Configures the shared scheduler before its first use, throws a logic_error afterwards
+	static void configure(const Config& config);
+	// The shared scheduler, started on first use
+	static Job_system& get();
+
+	// One worker per core besides the calling thread
+	static unsigned default_workers();
+	[[nodiscard]] unsigned get_worker_count() const { return static_cast<unsigned>(workers.size()); }
+
+	// Fork: queues `function()`, its captures must fit in Job::storage (capture by reference)
+	// `name` is stored by address (a string literal)
+	template<typename F>
+	void spawn(Job_counter& counter, const char* name, F&& function);
+
+	// Join: runs queued jobs until all those spawned with `counter` are done
+	void wait(const Job_counter& counter);
+
+	// Calls `function(from, to)` on sub-ranges of [begin, end[ of at most `grain` indices (0: automatic), returns when all done
+	template<typename F>
+	void parallel_for(const char* name, size_t begin, size_t end, size_t grain, F&& function);
+
+	// Maps the sub-ranges of at most `grain` indices with `map(from, to) -> T` in parallel,
+	// then folds the results with `reduce(T, T) -> T` in order, the result does not depend on the scheduling
+	template<typename T, typename M, typename R>
+	T parallel_reduce(const char* name, size_t begin, size_t end, size_t grain, T identity, M&& map, R&& reduce);
+
+	// A spawned function and its captures
+	struct Job {
+		static constexpr size_t storage = 64;
+
+		void (*run)(Job& job);
+		Job_counter* counter;
+		const char* name;
+		std::atomic<bool> busy{false}; // until executed, the slot can then be reused by its thread
+		bool pooled = true; // or allocated on the heap, when the pool of its thread is exhausted
+		alignas(std::max_align_t) unsigned char data[storage];
+	};
+
+private:
+	class Worker;
+	static thread_local Worker* current_worker; // of the calling thread, if any
+
+	Job* allocate();
+	void submit(Job* job);
+	Job* find_job();
+	void execute(Job* job);
+	void worker_main(unsigned index);
+	[[nodiscard]] size_t auto_grain(size_t count) const;
+
+	// Hands the upper halves of the range to the other threads, runs the lower one
+	template<typename F>
+	void split(Job_counter& counter, const char* name, size_t begin, size_t end, size_t grain, F& function);
+
+	Hooks hooks;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<bool> quit{false};
+
+	// Jobs spawned by other threads than the workers
+	std::mutex injected_mutex;
+	std::vector<Job*> injected; // FIFO from injected_head, cleared when drained: keeps its storage, where a deque allocates as it moves
+	size_t injected_head = 0;
+	std::atomic<size_t> injected_count{0};
+
+	// Idle workers
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::atomic<uint64_t> spawned{0}; // wakes the workers when changed
+	std::atomic<unsigned> sleeping{0};
+};
+
+template<typename F>
+void Job_system::spawn(Job_counter& counter, const char* name, F&& function)
+{
+	using Fn = std::decay_t<F>;
+	static_assert(sizeof(Fn) <= Job::storage, "Job_system::spawn: too many captures, capture by reference");
+	static_assert(alignof(Fn) <= alignof(std::max_align_t), "Job_system::spawn: over-aligned function");
+
+	Job* job = allocate();
+	new (job->data) Fn(std::forward<F>(function));
+	job->run = [](Job& self) {
+		Fn& fn = *std::launder(reinterpret_cast<Fn*>(self.data));
+		fn();
+		fn.~Fn();
+	};
+	job->counter = &counter;
+	job->name = name;
+	counter.pending.fetch_add(1, std::memory_order_relaxed);
+	submit(job);
+}
+
+template<typename F>
+void Job_system::split(Job_counter& counter, const char* name, size_t begin, size_t end, size_t grain, F& function)
+{
+	while (end - begin > grain) {
+		const size_t middle = begin + (end - begin) / 2;
+		spawn(counter, name, [this, &counter, name, middle, end, grain, &function]() {
+			split(counter, name, middle, end, grain, function);
+		});
+		end = middle;
+	}
+	function(begin, end);
+}
+
+template<typename F>
+void Job_system::parallel_for(const char* name, size_t begin, size_t end, size_t grain, F&& function)
+{
+	if (begin >= end) {
+		return;
+	}
+	if (grain == 0) {
+		grain = auto_grain(end - begin);
+	}
+	Job_counter counter;
+	split(counter, name, begin, end, grain, function);
+	wait(counter);
+}
+
+template<typename T, typename M, typename R>
+T Job_system::parallel_reduce(const char* name, size_t begin, size_t end, size_t grain, T identity, M&& map, R&& reduce)
+{
+	if (begin >= end) {
+		return identity;
+	}
+	if (grain == 0) {
+		grain = auto_grain(end - begin);
+	}
+	const size_t chunks = (end - begin + grain - 1) / grain;
+	std::vector<T> results(chunks, identity);
+	parallel_for(name, 0, chunks, 1, [&](size_t from, size_t to) {
+		for (size_t chunk = from; chunk < to; chunk++) {
+			const size_t chunk_begin = begin + chunk * grain;
+			results[chunk] = map(chunk_begin, std::min(chunk_begin + grain, end));
+		}
+	});
+	T result = std::move(identity);
+	for (T& partial: results) {
+		result = reduce(std::move(result), std::move(partial));
+	}
+	return result;
+}
+
+} // namespace Lib
+
+#endif //LIB_JOB_SYSTEM_HPP
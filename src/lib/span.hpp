@@ -0,0 +1,81 @@
+/*
+    3D Physics Simulations - Span: non-owning view of contiguous elements
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef LIB_SPAN_HPP
+#define LIB_SPAN_HPP
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+namespace Lib {
+
+// Pointer and size of contiguous elements, a subset of C++20's std::span
+// Brace-initialised spans refer to a temporary array, valid until the end of the full-expression (eg: a function call)
+template<typename T>
+class Span {
+public:
+	using element_type = T;
+	using value_type = std::remove_cv_t<T>;
+
+	constexpr Span() noexcept = default;
+	constexpr Span(T* data, size_t size) noexcept: ptr(data), count(size) {};
+
+	template<size_t N>
+	constexpr Span(T (&array)[N]) noexcept: ptr(array), count(N) {};
+
+	template<typename U, size_t N, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+	constexpr Span(std::array<U, N>& array) noexcept: ptr(array.data()), count(N) {};
+
+	template<typename U, size_t N, typename = std::enable_if_t<std::is_convertible_v<const U(*)[], T(*)[]>>>
+	constexpr Span(const std::array<U, N>& array) noexcept: ptr(array.data()), count(N) {};
+
+	// From vectors of any allocator
+	template<typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<U(*)[], T(*)[]>>>
+	Span(std::vector<U, A>& vector) noexcept: ptr(vector.data()), count(vector.size()) {};
+
+	template<typename U, typename A, typename = std::enable_if_t<std::is_convertible_v<const U(*)[], T(*)[]>>>
+	Span(const std::vector<U, A>& vector) noexcept: ptr(vector.data()), count(vector.size()) {};
+
+	// Read-only spans only
+	template<typename U = T, typename = std::enable_if_t<std::is_const_v<U>>>
+	constexpr Span(std::initializer_list<value_type> list) noexcept: ptr(std::data(list)), count(list.size()) {};
+
+	[[nodiscard]] constexpr T* data() const noexcept { return ptr; }
+	[[nodiscard]] constexpr size_t size() const noexcept { return count; }
+	[[nodiscard]] constexpr size_t size_bytes() const noexcept { return count * sizeof(T); }
+	[[nodiscard]] constexpr bool empty() const noexcept { return count == 0; }
+
+	constexpr T& operator[](size_t index) const noexcept { return ptr[index]; }
+	[[nodiscard]] constexpr T* begin() const noexcept { return ptr; }
+	[[nodiscard]] constexpr T* end() const noexcept { return ptr + count; }
+
+	[[nodiscard]] constexpr Span subspan(size_t offset, size_t size) const noexcept { return {ptr + offset, size}; }
+
+private:
+	T* ptr = nullptr;
+	size_t count = 0;
+};
+
+} // namespace Lib
+
+#endif //LIB_SPAN_HPP
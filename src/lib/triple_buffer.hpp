@@ -0,0 +1,76 @@
+/*
+    3D Physics Simulations - Triple buffer: lock-free handoff of the latest value between two threads
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef LIB_TRIPLE_BUFFER_HPP
+#define LIB_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace Lib {
+
+// Hands the latest value written by a single producer to a single consumer, neither ever waits
+// The producer fills `back()` then calls `publish()`, the consumer calls `acquire()` then reads `front()`
+// Values published while the consumer did not acquire are skipped
+template<typename T>
+class Triple_buffer {
+public:
+	Triple_buffer() = default;
+	explicit Triple_buffer(const T& initial): buffers{initial, initial, initial} {};
+	~Triple_buffer() = default;
+	Triple_buffer(const Triple_buffer&) = delete;
+	Triple_buffer(Triple_buffer&&) = delete;
+	Triple_buffer& operator=(const Triple_buffer&) = delete;
+	Triple_buffer& operator=(Triple_buffer&&) = delete;
+
+	// Producer side
+	T& back() { return buffers[back_index]; }
+
+	void publish()
+	{
+		// Releases the back buffer, takes the former middle one (maybe not acquired yet, then it is overwritten)
+		back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Consumer side
+	const T& front() const { return buffers[front_index]; }
+
+	// Takes the last published value, if any, returns false if `front()` is unchanged
+	bool acquire()
+	{
+		if ((middle.load(std::memory_order_relaxed) & fresh) == 0) {
+			return false;
+		}
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+private:
+	static constexpr std::uint8_t index_mask = 0x3;
+	static constexpr std::uint8_t fresh = 0x4; // set by publish(), cleared by acquire()
+
+	T buffers[3];
+	std::uint8_t back_index = 0; // producer only
+	std::atomic<std::uint8_t> middle{1};
+	std::uint8_t front_index = 2; // consumer only
+};
+
+} // namespace Lib
+
+#endif //LIB_TRIPLE_BUFFER_HPP
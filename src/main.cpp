@@ -18,9 +18,20 @@
 #include "main.hpp"
 #include "error.hpp"
 #include "context.hpp"
+#include "frame_arena.hpp"
+#include "frame_stats.hpp"
+#include "headless.hpp"
+#include "profiler.hpp"
 #include "contexts/menu.hpp"
+#include "lib/job_system.hpp"
 #include "renderer/utils.hpp"
 #include "renderer/texture.hpp"
+#include "renderer/stream_buffer.hpp"
+#include "renderer/gl_state.hpp"
+#include "renderer/gl_debug.hpp"
+#include "renderer/program_cache.hpp"
+#include "renderer/frame_capture.hpp"
+#include "renderer/texture_loader.hpp"
 
 // ImGui is included first in example programs
 #include <imgui/imgui.h>
@@ -30,8 +41,14 @@
 // OpenGL ES 3, no loader needed unless you need a specific extension
 #include <GLES3/gl3.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-using std::endl, std::cerr;
+#include <thread>
+using std::endl, std::cerr, std::cout;
+using std::literals::string_literals::operator""s;
 
 #ifdef EMSCRIPTEN
 #include <emscripten/emscripten.h>
@@ -42,43 +59,175 @@ namespace Engine {
 Context_holder Context_holder::instance;
 Main* Main::instance = nullptr;
 
+Options Options::parse(int argc, char* argv[])
+{
+	Options options;
+	for (int it = 1; it < argc; it++) {
+		const char* arg = argv[it];
+		const bool has_value = it + 1 < argc;
+		if (std::strcmp(arg, "--headless") == 0) {
+			options.headless = true;
+		}
+		else if (std::strcmp(arg, "--frames") == 0 && has_value) {
+			options.frames = std::strtoul(argv[++it], nullptr, 10);
+		}
+		else if (std::strcmp(arg, "--size") == 0 && has_value) {
+			if (std::sscanf(argv[++it], "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0) {
+				throw Error("Invalid --size, expected WIDTHxHEIGHT");
+			}
+		}
+		else if (std::strcmp(arg, "--scene") == 0 && has_value) {
+			options.scene = argv[++it];
+		}
+		else if (std::strcmp(arg, "--capture") == 0 && has_value) {
+			options.capture_png = argv[++it];
+		}
+		else if (std::strcmp(arg, "--capture-raw") == 0 && has_value) {
+			options.capture_raw = argv[++it];
+		}
+		else if (std::strcmp(arg, "--gl-stats") == 0 && has_value) {
+			options.gl_stats = argv[++it];
+		}
+		else if (std::strcmp(arg, "--trace") == 0 && has_value) {
+			options.trace = argv[++it];
+		}
+		else if (std::strcmp(arg, "--step-rate") == 0 && has_value) {
+			options.step_rate = std::strtoul(argv[++it], nullptr, 10);
+			if (options.step_rate == 0) {
+				throw Error("Invalid --step-rate, expected steps per second");
+			}
+		}
+		else if (std::strcmp(arg, "--max-steps") == 0 && has_value) {
+			options.max_steps = std::strtoul(argv[++it], nullptr, 10);
+			if (options.max_steps == 0) {
+				throw Error("Invalid --max-steps, expected at least 1");
+			}
+		}
+		else if (std::strcmp(arg, "--lockstep") == 0) {
+			options.lockstep = true;
+		}
+		else if (std::strcmp(arg, "--sim-thread") == 0) {
+			options.sim_thread = true;
+		}
+		else if (std::strcmp(arg, "--jobs") == 0 && has_value) {
+			char* end = nullptr;
+			options.jobs = static_cast<int>(std::strtol(argv[++it], &end, 10));
+			if (*end != '\0' || options.jobs < 0) {
+				throw Error("Invalid --jobs, expected a number of worker threads");
+			}
+		}
+		else if (std::strcmp(arg, "--pin-threads") == 0) {
+			options.pin_threads = true;
+		}
+		else if (std::strcmp(arg, "--shader-cache") == 0 && has_value) {
+			options.shader_cache = argv[++it];
+		}
+		else {
+			throw Error("Usage: "s + argv[0] + " [--headless] [--frames N] [--size WIDTHxHEIGHT] [--scene triangle|plane]"
+			            " [--capture PATTERN.png | --capture-raw FILE|'|command'] [--gl-stats FILE.jsonl] [--trace FILE.json]"
+			            " [--step-rate HZ] [--max-steps N] [--lockstep | --sim-thread] [--jobs N] [--pin-threads]"
+			            " [--shader-cache DIR]");
+		}
+	}
+	return options;
+}
+
+Main::Main() = default;
+Main::~Main() = default;
+
 void Main::terminate()
 {
-	glfwSetWindowShouldClose(window, GLFW_TRUE);
+	exit_requested = true;
+	if (window != nullptr) {
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+	}
 }
 
-void Main::init()
+bool Main::should_exit() const
 {
-	glfwSetErrorCallback(error_callback);
+	return exit_requested || (frame_limit > 0 && frame_count >= frame_limit) || (window != nullptr && glfwWindowShouldClose(window));
+}
 
-	if (!glfwInit()) {
-		throw Error("GLFW: cannot initialise");
+double Main::get_time() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+void Main::init(const Options& options)
+{
+	frame_limit = options.frames;
+	trace_filename = options.trace;
+	timestep.set_step(1.f / static_cast<float>(options.step_rate));
+	timestep.set_max_steps(options.max_steps);
+	lockstep = options.lockstep;
+	if (options.sim_thread) {
+#ifndef EMSCRIPTEN
+		if (lockstep) {
+			throw Error("--lockstep and --sim-thread are exclusive");
+		}
+		simulation.set_enabled(true);
+#else
+		throw Error("Simulation thread not available in the browser");
+#endif
+	}
+	if (!options.gl_stats.empty()) {
+		gl_stats_file.open(options.gl_stats);
+		if (!gl_stats_file) {
+			throw Error("Cannot open " + options.gl_stats);
+		}
 	}
+	PROFILE_THREAD("Main");
 
-	glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-	glfwWindowHint(GLFW_SAMPLES, MSAA_SAMPLES); // Multisampling (MSAA)
-	if constexpr (!ALLOW_RESIZING) glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-	if constexpr (WANT_DEBUG_CTX) glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-	window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, nullptr, nullptr);
-	if (!static_cast<bool>(window)) {
-		throw Error("GLFW: cannot create window");
+	// Shared by all the contexts, started on first use
+	Lib::Job_system::Config jobs;
+	if (options.jobs >= 0) {
+		jobs.workers = static_cast<unsigned>(options.jobs);
 	}
-	glfwMakeContextCurrent(window);
+	jobs.pin_workers = options.pin_threads;
+#ifdef WITH_PROFILER
+	jobs.hooks.worker_start = [](unsigned index) { Profiler::set_thread_name("Job worker " + std::to_string(index)); };
+	jobs.hooks.job = [](const char* name, void (*run)(void*), void* job) {
+		Profiler::Scope scope(name);
+		run(job);
+	};
+#endif
+	Lib::Job_system::configure(jobs);
+	display_width = options.width;
+	display_height = options.height;
+
+	if (options.headless) {
+#ifdef WITH_HEADLESS
+		headless = std::make_unique<Headless_display>(display_width, display_height, WANT_DEBUG_CTX);
+		Renderer::Gl_debug::get().init(eglGetProcAddress);
+#else
+		throw Error("Headless mode not available in this build (WITH_HEADLESS)");
+#endif
+	}
+	else {
+		glfwSetErrorCallback(error_callback);
+
+		if (!glfwInit()) {
+			throw Error("GLFW: cannot initialise");
+		}
+
+		glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+		glfwWindowHint(GLFW_SAMPLES, MSAA_SAMPLES); // Multisampling (MSAA)
+		if constexpr (!ALLOW_RESIZING) glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+		if constexpr (WANT_DEBUG_CTX) glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+		window = glfwCreateWindow(display_width, display_height, WINDOW_TITLE, nullptr, nullptr);
+		if (!static_cast<bool>(window)) {
+			throw Error("GLFW: cannot create window");
+		}
+		glfwMakeContextCurrent(window);
+		Renderer::Gl_debug::get().init(glfwGetProcAddress);
+	}
+	start_time = std::chrono::steady_clock::now();
 
 	// DearImGui sets and resets the Viewport dimensions at ImGui_ImplOpenGL3_RenderDrawData
 	glViewport(0, 0, display_width, display_height);
 
-	// TODO install user defined input callbacks here before initialising DearImGui !!
-	//glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int modifiers) { });
-	//glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int modifiers) {});
-	glfwSetWindowSizeCallback(window, []([[maybe_unused]] GLFWwindow* window, int w, int h) {
-		glViewport(0, 0, w, h);
-		Main::get()->display_height = h;
-		Main::get()->display_width = w;
-	});
-
 	// ImGui init: create a dear imgui context, setup some options, load fonts
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -87,39 +236,160 @@ void Main::init()
 	//   ImGuiIO &io = ImGui::GetIO();
 	//   e.g. 'io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard' to enable keyboard controls.
 	// TODO: Fill optional fields of the io structure later.
-	ImGui_ImplGlfw_InitForOpenGL(window, true);
+	if (window != nullptr) {
+		// TODO install user defined input callbacks here before initialising DearImGui !!
+		//glfwSetKeyCallback(window, [](GLFWwindow* window, int key, int scancode, int action, int modifiers) { });
+		//glfwSetMouseButtonCallback(window, [](GLFWwindow* window, int button, int action, int modifiers) {});
+		glfwSetWindowSizeCallback(window, []([[maybe_unused]] GLFWwindow* window, int w, int h) {
+			glViewport(0, 0, w, h);
+			Main::get()->display_height = h;
+			Main::get()->display_width = w;
+		});
+		ImGui_ImplGlfw_InitForOpenGL(window, true);
+	}
 	ImGui_ImplOpenGL3_Init();
 
 	Renderer::Image::init();
+	if (!options.shader_cache.empty()) {
+		Renderer::Program_cache::get().set_directory(options.shader_cache);
+	}
+
+	if (!options.capture_png.empty() || !options.capture_raw.empty()) {
+#ifndef EMSCRIPTEN
+		using Renderer::Frame_capture;
+		const GLuint source = is_headless() ? headless->get_framebuffer() : GL_NONE;
+		const unsigned writer_count = std::max(std::thread::hardware_concurrency() / 2, 1u);
+		if (!options.capture_png.empty()) {
+			capture = std::make_unique<Frame_capture>(Frame_capture::Format::png_sequence, options.capture_png, source, display_width, display_height, 3, 8, writer_count);
+		}
+		else {
+			capture = std::make_unique<Frame_capture>(Frame_capture::Format::raw, options.capture_raw, source, display_width, display_height);
+		}
+#else
+		throw Error("Frame capture not available in the browser");
+#endif
+	}
 
 	// Initial context is the menu
 	Contexts::Menu* menu = new Contexts::Menu;
 	Context_holder::get().menu = menu;
 	Context_holder::get().set_context(menu);
+	if (!options.scene.empty() && !menu->open(options.scene)) {
+		throw Error("Unknown scene: " + options.scene);
+	}
 }
 
 void Main::main_loop()
 {
+#ifdef WITH_PROFILER
+	Profiler::get().new_frame();
+#endif
+	PROFILE_SCOPE("Main::main_loop");
+
 	glClearColor(1.0, 1.0, 0.0, 1.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	ImGui_ImplOpenGL3_NewFrame();
-	ImGui_ImplGlfw_NewFrame();
-	ImGui::NewFrame();
+	double curr_t = get_time();
+	if (frame_count > 0) {
+		Frame_stats::get().record(static_cast<float>(curr_t - last_frame_t));
+	}
+
+	{
+		PROFILE_SCOPE("ImGui::NewFrame");
+		ImGui_ImplOpenGL3_NewFrame();
+		if (window != nullptr) {
+			ImGui_ImplGlfw_NewFrame();
+		}
+		else {
+			// No platform backend: no input, fixed display size
+			ImGuiIO& io = ImGui::GetIO();
+			io.DisplaySize = ImVec2(static_cast<float>(display_width), static_cast<float>(display_height));
+			io.DeltaTime = curr_t > last_frame_t ? static_cast<float>(curr_t - last_frame_t) : 1.f / 60.f;
+		}
+		ImGui::NewFrame();
+	}
+	// DearImGui rendered the previous frame with its own GL state
+	Renderer::Gl_state::get().new_frame();
+	if (gl_stats_file.is_open() && frame_count > 0) {
+		Renderer::Gl_state::get().write_json(gl_stats_file);
+	}
+	{
+		PROFILE_SCOPE("Texture_loader::update");
+		Renderer::Texture_loader::get().update();
+	}
 	// ---
 
-	// Render here
-	double curr_t = glfwGetTime();
-	Context_holder::get().get_context()->loop_run(curr_t - last_frame_t);
+	// Simulates in steps of constant duration, then renders between the last two steps
+	// Gets the context on each call: it may be switched by an update or the UI
+	const float frame_time = static_cast<float>(curr_t - last_frame_t);
 	last_frame_t = curr_t;
+	Context* ctx = Context_holder::get().get_context();
+	if (simulation.is_enabled() && ctx->is_threadable()) {
+		// Updated on the simulation thread, renders the latest published state
+		if (simulation.get_context() != ctx) {
+			simulation.start(ctx, timestep);
+		}
+		simulation.set_timestep(timestep);
+	}
+	else {
+		const unsigned steps = lockstep ? 1 : timestep.advance(frame_time);
+		PROFILE_SCOPE("Context::update");
+		for (unsigned it = 0; it < steps; it++) {
+			Context_holder::get().get_context()->update(timestep.get_step());
+		}
+	}
+	{
+		PROFILE_SCOPE("Context::render");
+		ctx = Context_holder::get().get_context();
+		ctx->render(lockstep || simulation.get_context() == ctx ? 1.f : timestep.get_alpha());
+	}
+	// Not updated concurrently anymore: the context may be deleted once switched
+	if (simulation.get_context() != nullptr && (simulation.get_context() != Context_holder::get().get_context() || !simulation.is_enabled())) {
+		simulation.stop();
+	}
+
+#ifndef EMSCRIPTEN
+	// Records the scene, without the UI
+	if (capture) {
+		PROFILE_SCOPE("Frame_capture::capture");
+		capture->capture();
+	}
+#endif
+
+	Frame_stats::get().draw_window();
+	Frame_arena::get().draw_window();
+	timestep.draw_window();
+	simulation.draw_window();
+	Renderer::Gl_state::get().draw_window();
+#ifdef WITH_PROFILER
+	Profiler::get().draw_window();
+#endif
 
 	// ---
-	ImGui::Render();
-	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	{
+		PROFILE_SCOPE("ImGui::Render");
+		ImGui::Render();
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	}
+
+	// Protect the streamed data of this frame from being overwritten while in use by the GPU
+	Renderer::Stream_buffer::vertices().end_frame();
+	Renderer::Stream_buffer::indices().end_frame();
+
+	// Reports the GL errors of this frame, without stalling the pipeline
+	Renderer::Gl_debug::get().new_frame();
 
-	glFlush(); Renderer::check_gl_error("glFlush");
-	glfwSwapBuffers(window);
-	glfwPollEvents();
+	{
+		PROFILE_SCOPE("Swap buffers");
+		glFlush();
+		if (window != nullptr) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+	}
+	// The transient data of this frame is released
+	Frame_arena::get().reset();
+	frame_count++;
 }
 
 void Main::run_main_loop()
@@ -127,23 +397,59 @@ void Main::run_main_loop()
 #ifdef EMSCRIPTEN
 	emscripten_set_main_loop([]() { Main::get()->main_loop(); }, 0, 1);
 #else
-	while (!glfwWindowShouldClose(window)) {
+	while (!should_exit()) {
 		main_loop();
 	}
+	if (is_headless()) {
+		glFinish();
+		double elapsed = get_time();
+		cout << frame_count << " frames in " << elapsed << "s (" << frame_count / elapsed << " fps)" << endl;
+		const Frame_stats::Summary summary = Frame_stats::get().summarise();
+		cout << "Last " << summary.frames << " frames: p50 " << summary.p50 * 1e3f << "ms, p95 " << summary.p95 * 1e3f
+		     << "ms, p99 " << summary.p99 * 1e3f << "ms, max " << summary.max * 1e3f << "ms, "
+		     << Frame_stats::get().get_total_hitches() << " hitches" << endl;
+		const Frame_arena::Stats& arena = Frame_arena::get().get_stats();
+		cout << "Frame arena: " << arena.peak / 1024 << " KiB peak";
+#ifndef NDEBUG
+		cout << ", " << arena.heap_allocations << " heap allocations in the last frame";
+#endif
+		cout << endl;
+	}
 #endif
 }
 
 void Main::cleanup()
 {
+	simulation.stop();
+#ifndef EMSCRIPTEN
+	if (capture) {
+		const Renderer::Frame_capture::Stats stats = capture->get_stats();
+		capture.reset(); // writes the remaining frames
+		cout << "Captured " << stats.captured << " frames, " << stats.stalls << " stalls" << endl;
+	}
+#endif
+#ifdef WITH_PROFILER
+	if (!trace_filename.empty()) {
+		try {
+			Profiler::get().export_chrome_trace(trace_filename);
+		}
+		catch (const std::exception& ex) {
+			cerr << ex.what() << endl;
+		}
+	}
+#endif
 	if (ImGui::GetCurrentContext() != nullptr) {
 		ImGui_ImplOpenGL3_Shutdown();
-		ImGui_ImplGlfw_Shutdown();
+		if (window != nullptr) {
+			ImGui_ImplGlfw_Shutdown();
+		}
 		ImGui::DestroyContext();
 	}
 	if (window != nullptr) {
 		glfwDestroyWindow(window);
 	}
 	glfwTerminate(); // safe
+	headless.reset();
 }
 
 void Main::error_callback(int error, const char* description)
@@ -155,13 +461,13 @@ void Main::error_callback(int error, const char* description)
 
 using Engine::Main;
 
-int main(void)
+int main(int argc, char* argv[])
 {
 	Main main;
 	Main::instance = &main;
 
 	try {
-		main.init();
+		main.init(Engine::Options::parse(argc, argv));
 		main.run_main_loop();
 	}
 	catch (const std::exception& ex) {
@@ -23,8 +23,16 @@
 // GLFW is the modern, portable way to create a Window and an OpenGL (ES) context
 #include <GLFW/glfw3.h>
 
+#include "fixed_timestep.hpp"
+#include "simulation_thread.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+
 // Forward declaration of main function required to add it as a friend to class Main
-int main();
+int main(int argc, char* argv[]);
 
 namespace Engine {
 
@@ -36,9 +44,35 @@ constexpr int WINDOW_WIDTH = 1280;
 constexpr const char* WINDOW_TITLE = "Simulation";
 constexpr bool ALLOW_RESIZING = true;
 
+class Headless_display;
+namespace Renderer { class Frame_capture; }
+
+// Command line options, selected at startup
+struct Options {
+	bool headless = false; // --headless: offscreen EGL context, no window nor input (requires WITH_HEADLESS)
+	unsigned frames = 0; // --frames N: exits after N frames, 0 to run until terminated
+	int width = WINDOW_WIDTH; // --size WxH
+	int height = WINDOW_HEIGHT;
+	std::string scene; // --scene NAME: initial context instead of the menu (see Contexts::Menu::open)
+	std::string capture_png; // --capture PATTERN: records the scene as a PNG sequence, eg: "frame_%05u.png"
+	std::string capture_raw; // --capture-raw PATH: records the scene as raw RGBA frames, to a file or a '|command'
+	std::string gl_stats; // --gl-stats FILE: writes the GL counters of every frame as JSON lines (see Gl_state::write_json)
+	std::string trace; // --trace FILE: exports the profiled scopes as a Chrome trace on exit (requires WITH_PROFILER)
+	unsigned step_rate = 60; // --step-rate HZ: simulation steps per second
+	unsigned max_steps = 5; // --max-steps N: simulation steps per frame before dropping time
+	bool lockstep = false; // --lockstep: exactly one simulation step per frame, whatever the frame time (deterministic captures)
+	bool sim_thread = false; // --sim-thread: updates the scene on a dedicated thread, rendering its latest state
+	int jobs = -1; // --jobs N: worker threads of the job system, -1 for one per core besides the main thread
+	bool pin_threads = false; // --pin-threads: runs each job worker on its own core (Linux)
+	std::string shader_cache; // --shader-cache DIR: program binaries directory, next to the executable if empty
+
+	// throws an Engine::Error on invalid arguments
+	static Options parse(int argc, char* argv[]);
+};
+
 class Main final {
 public:
-	void init(); // Call once at the very beginning
+	void init(const Options& options); // Call once at the very beginning
 	void main_loop(); // you're probably looking for `run_main_loop()`
 	void run_main_loop(); // Does not return, runs `main_loop()` in loop
 	void cleanup(); // Call once at the very end
@@ -51,17 +85,36 @@ public:
 	int display_width = WINDOW_WIDTH;
 	int display_height = WINDOW_HEIGHT;
 
+	// Whether rendering to an offscreen framebuffer, without a window
+	[[nodiscard]] bool is_headless() const { return headless != nullptr; }
+
 private:
 	GLFWwindow* window = nullptr;
+	std::unique_ptr<Headless_display> headless;
+#ifndef EMSCRIPTEN
+	std::unique_ptr<Renderer::Frame_capture> capture;
+#endif
+	bool exit_requested = false;
+	unsigned frame_limit = 0;
+	unsigned frame_count = 0;
+	std::string trace_filename;
+	std::ofstream gl_stats_file;
+	Fixed_timestep timestep;
+	bool lockstep = false;
+	Simulation_thread simulation;
+	std::chrono::steady_clock::time_point start_time; // GLFW is not initialised in headless mode
 	double last_frame_t = 0;
 	static Main* instance; // Please set the instance (in main())
 
+	[[nodiscard]] bool should_exit() const;
+	[[nodiscard]] double get_time() const; // seconds since init
+
 	static void error_callback(int, const char*);
 
-	friend int ::main(); // Main can only be constructed in function main()
+	friend int ::main(int, char*[]); // Main can only be constructed in function main()
 
-	Main() = default;
-	~Main() = default;
+	Main();
+	~Main();
 	Main(const Main&) = delete;
 	Main(const Main&&) = delete;
 	Main& operator=(const Main&) = delete;
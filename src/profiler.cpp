@@ -0,0 +1,261 @@
+/*
+    3D Physics Simulations - Profiler: hierarchical CPU profiler, per thread event rings
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "profiler.hpp"
+
+#include <imgui/imgui.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+using std::literals::string_literals::operator""s;
+
+namespace Engine {
+
+uint64_t Profiler::now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+Profiler::Thread_buffer& Profiler::thread_buffer()
+{
+	thread_local Thread_buffer* buffer = nullptr;
+	if (buffer == nullptr) {
+		Profiler& profiler = get();
+		std::lock_guard<std::mutex> lock(profiler.mutex);
+		auto id = static_cast<uint32_t>(profiler.threads.size());
+		profiler.threads.push_back(std::make_unique<Thread_buffer>());
+		buffer = profiler.threads.back().get();
+		buffer->id = id;
+		buffer->name = "Thread " + std::to_string(id);
+	}
+	return *buffer;
+}
+
+void Profiler::set_thread_name(const std::string& name)
+{
+	Thread_buffer& buffer = thread_buffer();
+	std::lock_guard<std::mutex> lock(get().mutex); // read by the main thread
+	buffer.name = name;
+}
+
+uint64_t Profiler::begin()
+{
+	thread_buffer().depth++;
+	return now_ns();
+}
+
+void Profiler::end(const char* name, uint64_t start_ns)
+{
+	const uint64_t end_ns = now_ns();
+	Thread_buffer& buffer = thread_buffer();
+	buffer.depth--;
+	// Only this thread writes, the readers discard the slots that may have been overwritten while copying
+	const uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	Slot& slot = buffer.events[head & (ring_size - 1)];
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.start_ns.store(start_ns, std::memory_order_relaxed);
+	slot.end_ns.store(end_ns, std::memory_order_relaxed);
+	slot.depth.store(buffer.depth, std::memory_order_relaxed);
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::copy_events(const Thread_buffer& buffer, uint64_t from_ns, uint64_t to_ns, std::vector<Event>& out)
+{
+	const uint64_t head = buffer.head.load(std::memory_order_acquire);
+	const uint64_t first = head > ring_size ? head - ring_size : 0;
+	const size_t out_first = out.size();
+	std::vector<uint64_t>& indices = copied_indices;
+	indices.clear();
+	for (uint64_t it = first; it < head; it++) {
+		const Slot& slot = buffer.events[it & (ring_size - 1)];
+		const Event event{
+			slot.name.load(std::memory_order_relaxed), slot.start_ns.load(std::memory_order_relaxed),
+			slot.end_ns.load(std::memory_order_relaxed), slot.depth.load(std::memory_order_relaxed)
+		};
+		if (event.end_ns > from_ns && event.start_ns < to_ns) {
+			out.push_back(event);
+			indices.push_back(it);
+		}
+	}
+	// The writer may have wrapped around during the copy: drop the slots it may have overwritten,
+	// including the one of `new_head` possibly being written
+	std::atomic_thread_fence(std::memory_order_acquire);
+	const uint64_t new_head = buffer.head.load(std::memory_order_relaxed);
+	const uint64_t valid = new_head + 1 > ring_size ? new_head + 1 - ring_size : 0;
+	const auto overwritten = std::lower_bound(indices.begin(), indices.end(), valid) - indices.begin();
+	out.erase(out.begin() + out_first, out.begin() + out_first + overwritten);
+}
+
+void Profiler::new_frame()
+{
+	last_frame_start_ns = frame_start_ns;
+	frame_start_ns = now_ns();
+}
+
+void Profiler::take_snapshot(uint64_t from_ns, uint64_t to_ns)
+{
+	snapshot_from_ns = from_ns;
+	snapshot_to_ns = to_ns;
+	std::lock_guard<std::mutex> lock(mutex);
+	snapshot.resize(threads.size());
+	for (size_t it = 0; it < threads.size(); it++) {
+		snapshot[it].name = threads[it]->name;
+		snapshot[it].id = threads[it]->id;
+		snapshot[it].events.clear();
+		copy_events(*threads[it], from_ns, to_ns, snapshot[it].events);
+	}
+}
+
+void Profiler::draw_window()
+{
+	if (!paused && last_frame_start_ns < frame_start_ns) {
+		take_snapshot(last_frame_start_ns, frame_start_ns);
+	}
+
+	ImGuiIO& io = ImGui::GetIO();
+	ImGui::SetNextWindowPos(ImVec2{0.f, io.DisplaySize.y}, ImGuiCond_FirstUseEver, ImVec2{0.f, 1.f});
+	ImGui::SetNextWindowSize(ImVec2{io.DisplaySize.x, 0.f}, ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Profiler")) {
+		ImGui::End();
+		return;
+	}
+
+	bool is_on = is_enabled();
+	if (ImGui::Checkbox("Enabled", &is_on)) {
+		set_enabled(is_on);
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Pause", &paused);
+	ImGui::SameLine();
+	if (ImGui::Button("Export trace")) {
+		try {
+			export_chrome_trace("profile.json");
+			export_status = "Exported to profile.json";
+		}
+		catch (const std::exception& ex) {
+			export_status = ex.what();
+		}
+	}
+	if (!export_status.empty()) {
+		ImGui::SameLine();
+		ImGui::TextUnformatted(export_status.c_str());
+	}
+
+	const double frame_ns = static_cast<double>(snapshot_to_ns - snapshot_from_ns);
+	ImGui::Text("Frame: %.3fms", frame_ns / 1e6);
+	if (frame_ns <= 0.) {
+		ImGui::End();
+		return;
+	}
+
+	// One lane per thread, one row per nesting level, bars scaled to the frame duration
+	const float row_height = ImGui::GetTextLineHeightWithSpacing();
+	const float label_width = ImGui::CalcTextSize("Texture_loader 00").x;
+	const float bars_width = std::max(ImGui::GetContentRegionAvail().x - label_width, 1.f);
+	const double scale = bars_width / frame_ns;
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	for (const Lane& lane: snapshot) {
+		if (lane.events.empty()) {
+			continue;
+		}
+		uint32_t max_depth = 0;
+		for (const Event& event: lane.events) {
+			max_depth = std::max(max_depth, event.depth);
+		}
+		const ImVec2 origin = ImGui::GetCursorScreenPos();
+		ImGui::TextUnformatted(lane.name.c_str());
+		const float bars_x = origin.x + label_width;
+		for (const Event& event: lane.events) {
+			const float x0 = bars_x + static_cast<float>((std::max(event.start_ns, snapshot_from_ns) - snapshot_from_ns) * scale);
+			const float x1 = bars_x + static_cast<float>((std::min(event.end_ns, snapshot_to_ns) - snapshot_from_ns) * scale);
+			const float y0 = origin.y + event.depth * row_height;
+			const ImVec2 min{x0, y0}, max{std::max(x1, x0 + 1.f), y0 + row_height - 1.f};
+			// The colour identifies the scope name
+			const size_t hash = std::hash<const void*>{}(event.name) * 0x9E3779B97F4A7C15ull;
+			const ImU32 colour = IM_COL32(80 + (hash >> 8) % 150, 80 + (hash >> 16) % 150, 80 + (hash >> 24) % 150, 255);
+			draw_list->AddRectFilled(min, max, colour);
+			if (ImGui::CalcTextSize(event.name).x < max.x - min.x) {
+				draw_list->PushClipRect(min, max, true);
+				draw_list->AddText(min, IM_COL32_WHITE, event.name);
+				draw_list->PopClipRect();
+			}
+			if (ImGui::IsMouseHoveringRect(min, max)) {
+				ImGui::SetTooltip("%s: %.3fms", event.name, (event.end_ns - event.start_ns) / 1e6);
+			}
+		}
+		ImGui::SetCursorScreenPos(origin);
+		ImGui::Dummy(ImVec2{label_width + bars_width, (max_depth + 1) * row_height});
+	}
+
+	ImGui::End();
+}
+
+// Escapes the characters not allowed in a JSON string
+static std::string json_escape(const char* text)
+{
+	std::string res;
+	for (const char* it = text; *it != '\0'; it++) {
+		if (*it == '"' || *it == '\\') {
+			res += '\\';
+		}
+		if (static_cast<unsigned char>(*it) >= 0x20) {
+			res += *it;
+		}
+	}
+	return res;
+}
+
+void Profiler::export_chrome_trace(const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (!out) {
+		throw std::runtime_error("Profiler: cannot open "s + filename);
+	}
+	// Timestamps are in microseconds
+	out << "{\"traceEvents\":[\n";
+	out.precision(3);
+	out << std::fixed;
+	bool first = true;
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const std::unique_ptr<Thread_buffer>& buffer: threads) {
+		out << (first ? "" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->id
+		    << R"(,"args":{"name":")" << json_escape(buffer->name.c_str()) << "\"}}";
+		first = false;
+		std::vector<Event> events;
+		copy_events(*buffer, 0, UINT64_MAX, events);
+		for (const Event& event: events) {
+			out << ",\n" << R"({"name":")" << json_escape(event.name) << R"(","ph":"X","pid":1,"tid":)" << buffer->id
+			    << ",\"ts\":" << event.start_ns / 1e3 << ",\"dur\":" << (event.end_ns - event.start_ns) / 1e3 << "}";
+		}
+	}
+	out << "\n]}\n";
+	if (!out) {
+		throw std::runtime_error("Profiler: cannot write "s + filename);
+	}
+}
+
+Profiler& Profiler::get()
+{
+	static Profiler instance;
+	return instance;
+}
+
+} // namespace Engine
@@ -0,0 +1,164 @@
+/*
+    3D Physics Simulations - Profiler: hierarchical CPU profiler, per thread event rings
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_PROFILER_HPP
+#define SIMULATION_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// PROFILE_SCOPE: records the duration of the enclosing scope, `name` must be a string literal (its address is stored)
+// PROFILE_THREAD: names the calling thread in the timeline
+// Compiled out without WITH_PROFILER, a single relaxed atomic load when disabled at runtime
+#ifdef WITH_PROFILER
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+#define PROFILE_SCOPE(name) ::Engine::Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_THREAD(name) ::Engine::Profiler::set_thread_name(name)
+#else
+#define PROFILE_SCOPE(name) static_cast<void>(0)
+#define PROFILE_THREAD(name) static_cast<void>(0)
+#endif
+
+namespace Engine {
+
+// Each thread records its scopes into its own ring buffer, no locking on the recording path
+// The main thread marks the frames, draws the last frame as a timeline, and exports the rings as a Chrome trace
+class Profiler {
+public:
+	struct Event {
+		const char* name;
+		uint64_t start_ns; // since the profiler epoch
+		uint64_t end_ns;
+		uint32_t depth; // nesting level in its thread
+	};
+
+	class Scope {
+	public:
+		explicit Scope(const char* name) noexcept: name(is_enabled() ? name : nullptr)
+		{
+			if (this->name != nullptr) {
+				start_ns = begin();
+			}
+		}
+		~Scope()
+		{
+			if (name != nullptr) {
+				end(name, start_ns);
+			}
+		}
+		Scope(const Scope&) = delete;
+		Scope(Scope&&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		Scope& operator=(Scope&&) = delete;
+
+	private:
+		const char* name;
+		uint64_t start_ns = 0;
+	};
+
+	[[nodiscard]] static bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+	static void set_enabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+	// Nanoseconds since the profiler epoch
+	[[nodiscard]] static uint64_t now_ns();
+
+	// Name of the calling thread in the timeline and the trace
+	static void set_thread_name(const std::string& name);
+
+	// Marks the beginning of a frame, call from the main thread
+	void new_frame();
+
+	// Timeline of the last frame, call between ImGui::NewFrame and ImGui::Render
+	void draw_window();
+
+	// Writes all the buffered events in the Chrome trace event format (chrome://tracing, ui.perfetto.dev)
+	// throws a runtime_exception if the file cannot be written
+	void export_chrome_trace(const std::string& filename);
+
+	// Lazy initialised singleton
+	static Profiler& get();
+
+private:
+	Profiler() = default;
+	~Profiler() = default;
+	Profiler(const Profiler&) = delete;
+	Profiler(Profiler&&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+	Profiler& operator=(Profiler&&) = delete;
+
+	static constexpr uint64_t ring_size = 1 << 14; // events per thread, a power of 2
+
+	// An Event in a ring, relaxed atomics: read by other threads while being overwritten, see copy_events
+	struct Slot {
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> start_ns;
+		std::atomic<uint64_t> end_ns;
+		std::atomic<uint32_t> depth;
+	};
+
+	struct Thread_buffer {
+		std::string name;
+		uint32_t id;
+		std::unique_ptr<Slot[]> events{new Slot[ring_size]};
+		std::atomic<uint64_t> head{0}; // events ever written, published with release semantics
+		uint32_t depth = 0; // owner thread only
+	};
+
+	// Events of a thread, in a snapshot
+	struct Lane {
+		std::string name;
+		uint32_t id;
+		std::vector<Event> events;
+	};
+
+	static uint64_t begin();
+	static void end(const char* name, uint64_t start_ns);
+	static Thread_buffer& thread_buffer(); // registers the calling thread on first use
+
+	// Copies the events of `buffer` ending after `from_ns` and starting before `to_ns`
+	void copy_events(const Thread_buffer& buffer, uint64_t from_ns, uint64_t to_ns, std::vector<Event>& out);
+	void take_snapshot(uint64_t from_ns, uint64_t to_ns);
+
+	static inline std::atomic<bool> enabled{true};
+	static inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::mutex mutex; // registered threads
+	std::vector<std::unique_ptr<Thread_buffer>> threads; // kept once the thread exits, the events remain exportable
+
+	std::vector<uint64_t> copied_indices; // scratch buffer of copy_events, under mutex
+
+	uint64_t frame_start_ns = 0;
+	uint64_t last_frame_start_ns = 0;
+
+	// Timeline UI (main thread)
+	bool paused = false;
+	std::vector<Lane> snapshot;
+	uint64_t snapshot_from_ns = 0, snapshot_to_ns = 0;
+	std::string export_status;
+};
+
+} // namespace Engine
+
+#endif //SIMULATION_PROFILER_HPP
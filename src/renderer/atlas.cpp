@@ -0,0 +1,113 @@
+/*
+    3D Physics Simulations - Atlas: packs many images into few textures
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "atlas.hpp"
+
+#include <algorithm>
+
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <imgui/imstb_rectpack.h>
+
+namespace Engine::Renderer {
+
+Texture_atlas::Texture_atlas(int page_size, int padding):
+		page_size(page_size), padding(padding)
+{}
+
+Texture_atlas::Handle Texture_atlas::add(const Image& image)
+{
+	const int width = image.get_width();
+	const int height = image.get_height();
+	if (width + 2 * padding > page_size || height + 2 * padding > page_size) {
+		throw std::runtime_error("Texture_atlas::add: image too big for an atlas page");
+	}
+
+	const int channels = image.get_channels();
+	const int align = image.get_row_align();
+	const int pitch = (width * channels + align - 1) / align * align;
+
+	Pending_image pending{width, height, std::vector<unsigned char>(width * height * 4)};
+	for (int y = 0; y < height; y++) {
+		const unsigned char* src = image.get_raster() + y * pitch;
+		unsigned char* dst = pending.rgba.data() + y * width * 4;
+		for (int x = 0; x < width; x++, src += channels, dst += 4) {
+			switch (channels) {
+				case 1:  dst[0] = dst[1] = dst[2] = src[0]; dst[3] = 0xFF; break;
+				case 2:  dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; break;
+				case 3:  dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 0xFF; break;
+				default: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3];
+			}
+		}
+	}
+	images.push_back(std::move(pending));
+	regions.push_back({nullptr, glm::vec2(0), glm::vec2(width, height)});
+	return regions.size() - 1;
+}
+
+void Texture_atlas::build(GLenum filtering)
+{
+	std::vector<stbrp_rect> rects(images.size());
+	for (size_t it = 0; it < images.size(); it++) {
+		rects[it].id = static_cast<int>(it);
+		rects[it].w = images[it].width + 2 * padding;
+		rects[it].h = images[it].height + 2 * padding;
+		rects[it].was_packed = 0;
+	}
+
+	std::vector<stbrp_node> nodes(page_size);
+	std::vector<size_t> page_of(images.size());
+	std::vector<std::vector<unsigned char>> page_rasters;
+
+	// Fill a page with as many remaining images as possible, until all images are packed
+	auto remaining_end = rects.end();
+	while (remaining_end != rects.begin()) {
+		stbrp_context ctx;
+		stbrp_init_target(&ctx, page_size, page_size, nodes.data(), static_cast<int>(nodes.size()));
+		stbrp_pack_rects(&ctx, &*rects.begin(), static_cast<int>(remaining_end - rects.begin()));
+
+		std::vector<unsigned char>& raster = page_rasters.emplace_back(page_size * page_size * 4, 0);
+		for (auto it = rects.begin(); it != remaining_end; ++it) {
+			if (!it->was_packed) continue;
+			const Pending_image& image = images[it->id];
+			page_of[it->id] = page_rasters.size() - 1;
+			regions[it->id].pos = glm::vec2(it->x + padding, it->y + padding);
+
+			// Copy with extrusion: the padding repeats the border texels
+			for (int y = -padding; y < image.height + padding; y++) {
+				const int src_y = std::clamp(y, 0, image.height - 1);
+				unsigned char* dst = raster.data() + ((it->y + padding + y) * page_size + it->x) * 4;
+				for (int x = -padding; x < image.width + padding; x++, dst += 4) {
+					const int src_x = std::clamp(x, 0, image.width - 1);
+					std::copy_n(image.rgba.data() + (src_y * image.width + src_x) * 4, 4, dst);
+				}
+			}
+		}
+		remaining_end = std::partition(rects.begin(), remaining_end, [](const stbrp_rect& rect) { return !rect.was_packed; });
+	}
+
+	pages.clear();
+	pages.reserve(page_rasters.size());
+	for (std::vector<unsigned char>& raster: page_rasters) {
+		pages.emplace_back(Image(page_size, page_size, 4, raster.data()), filtering, GL_CLAMP_TO_EDGE);
+	}
+	for (size_t it = 0; it < regions.size(); it++) {
+		regions[it].texture = &pages[page_of[it]];
+	}
+}
+
+} // namespace Engine::Renderer
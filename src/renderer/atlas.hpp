@@ -0,0 +1,76 @@
+/*
+    3D Physics Simulations - Atlas: packs many images into few textures
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_ATLAS_HPP
+#define SIMULATION_ATLAS_HPP
+
+#include "texture.hpp"
+
+#include <glm/vec2.hpp>
+
+#include <vector>
+
+namespace Engine::Renderer {
+
+// A sub-rectangle of an atlas page, in texels (see Blitter::blit)
+struct Atlas_region {
+	const Texture* texture;
+	glm::vec2 pos;
+	glm::vec2 dim;
+};
+
+// Packs many images into one or more large RGBA textures (pages), so they can be drawn without texture switches
+// Each image is surrounded by `padding` texels extruded from its borders to avoid bleeding when filtering
+class Texture_atlas {
+public:
+	using Handle = size_t;
+
+	explicit Texture_atlas(int page_size = 2048, int padding = 1);
+	~Texture_atlas() = default;
+	Texture_atlas(const Texture_atlas&) = delete;
+	Texture_atlas(Texture_atlas&&) = delete;
+	Texture_atlas& operator=(const Texture_atlas&) = delete;
+	Texture_atlas& operator=(Texture_atlas&&) = delete;
+
+	// Copies the image (converted to RGBA), its region is available after `build()`
+	// throws a runtime_exception if the image does not fit in a page
+	Handle add(const Image& image);
+
+	// Packs the images added so far into pages and uploads them (previous pages are replaced)
+	void build(GLenum filtering = GL_NEAREST);
+
+	[[nodiscard]] const Atlas_region& get(Handle handle) const { return regions.at(handle); }
+	[[nodiscard]] size_t get_page_count() const { return pages.size(); }
+
+private:
+	struct Pending_image {
+		int width, height;
+		std::vector<unsigned char> rgba;
+	};
+
+	const int page_size;
+	const int padding;
+	std::vector<Pending_image> images;
+	std::vector<Atlas_region> regions;
+	std::vector<Texture> pages;
+};
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_ATLAS_HPP
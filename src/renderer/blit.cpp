@@ -16,32 +16,358 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "blit.hpp"
+#include "polygon.hpp"
+#include "stream_buffer.hpp"
 #include "utils.hpp"
+#include "../frame_arena.hpp"
+#include "../profiler.hpp"
 
 #include <glm/ext/matrix_transform.hpp>
 #include <imgui/imgui.h>
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <tuple>
+
 namespace Engine::Renderer {
 
-Blitter::Blitter(const Renderer& renderer) :
-		renderer(renderer), buf_name(generateArray<glGenBuffers>()), plane()
-{}
+// Unit square, same vertices as the Blitter::Plane mesh (UVs are equal to vertices)
+static constexpr GLfloat plane_xy[] = { 0, 0,   0, 1,   1, 1,   1, 0 };
+static constexpr GLsizei plane_vx_count = 4;
+
+// Unit circles (radius=1.0 around (0, 0)) for every level of detail, in a static vertex buffer and in client memory
+// The LOD of `n` vertices is a triangle fan: the centre, the `n` vertices of the ring, then the first ring vertex again
+class Circle_lods {
+public:
+	static constexpr int min_vertices = 5;
+	static constexpr int max_vertices = 128; // reached for a radius of ~1.5M pixels, see `ideal_vertices_for_radius`
+
+	// Index of the first vertex (the centre) of the fan of the LOD of `vx_count` vertices
+	[[nodiscard]] GLint get_first(int vx_count) const { return firsts[vx_count]; }
+	// Fan of the LOD of `vx_count` vertices, `+ 2` to skip the centre and get the ring
+	[[nodiscard]] const GLfloat* get_xy(int vx_count) const { return xy.data() + firsts[vx_count] * 2; }
+	[[nodiscard]] GLuint get_buffer_name() const { return vbo; }
+
+	Circle_lods(const Circle_lods&) = delete;
+	Circle_lods(Circle_lods&&) = delete;
+	Circle_lods& operator=(const Circle_lods&) = delete;
+	Circle_lods& operator=(Circle_lods&&) = delete;
+
+	// Lazy initialised singleton
+	static const Circle_lods& get();
+
+private:
+	Circle_lods();
+	~Circle_lods();
+
+	std::vector<GLfloat> xy;
+	std::array<GLint, max_vertices + 1> firsts{};
+	GLuint vbo;
+};
+
+Circle_lods::Circle_lods():
+		vbo(generateArray<glGenBuffers>())
+{
+	for (int vx_count = min_vertices; vx_count <= max_vertices; vx_count++) {
+		firsts[vx_count] = static_cast<GLint>(xy.size() / 2);
+		const float angle = PI_2 / static_cast<float>(vx_count);
+		xy.insert(xy.end(), {0.f, 0.f});
+		for (int it = 0; it < vx_count; it++) {
+			xy.insert(xy.end(), {cosf(angle * static_cast<float>(it)), sinf(angle * static_cast<float>(it))});
+		}
+		xy.insert(xy.end(), {1.f, 0.f});
+	}
+
+	Gl_state::get().bind_buffer(GL_ARRAY_BUFFER, vbo);
+	Gl_state::get().buffer_data(GL_ARRAY_BUFFER, xy.size() * sizeof(GLfloat), xy.data(), GL_STATIC_DRAW);
+	check_gl_error("Circle_lods::ctor");
+}
 
-void Blitter::blit(const Texture& tex, const glm::mat4& model_matrix, const glm::mat3& texture_matrix, const glm::vec4& tint) const
+Circle_lods::~Circle_lods()
 {
-	glActiveTexture(GL_TEXTURE0 + Renderer::texture_unit_name);
-	glBindTexture(GL_TEXTURE_2D, tex.get_texture_name());
-	renderer.set_has_texture(true);
+	glDeleteBuffers(1, &vbo);
+	Gl_state::get().deleted_buffer(vbo);
+}
+
+const Circle_lods& Circle_lods::get()
+{
+	static Circle_lods instance;
+	return instance;
+}
 
-	renderer.set_model_matrix(model_matrix);
-	renderer.set_texture_matrix(texture_matrix);
+// computes the ideal number of vertices for the given radius so the circle looks smooth
+template<bool LINEAR = false>
+static inline int ideal_vertices_for_radius(float radius)
+{
+	constexpr float min_vx_number = Circle_lods::min_vertices; // generate at least this number of vertices
+	constexpr float   coefficient = 6.f;   // the bigger the smoother (the slower)
+	constexpr float  start_growth = 4.f;   // minimum radius for which this function begins to generate more than `min_vx_number` vertices
 
-	renderer.set_tint_colour(tint);
+	float prim_gen_number;
+	if constexpr (LINEAR) {
+		prim_gen_number = std::ceil(std::max(0.f, radius - start_growth) * coefficient + min_vx_number); // best coefficient is .5
+	}
+	else {
+		float variable = std::max(0.f, radius - start_growth);
+		prim_gen_number = std::ceil(std::log2(1.f + variable) * coefficient + min_vx_number); // best coefficient is 6
+	}
+
+	return static_cast<int>(std::min(prim_gen_number, static_cast<float>(Circle_lods::max_vertices)));
+}
+
+Blitter::Blitter() :
+		flat_renderer(Renderer::get(0)),
+		textured_renderer(Renderer::get(Renderer::textured)),
+		batch_renderer(Renderer::get(Renderer::vertex_colour)),
+		batch_textured_renderer(Renderer::get(Renderer::vertex_colour | Renderer::textured)),
+		discs_renderer(Renderer::get(Renderer::instanced_2d)),
+		plane(),
+		batch_vao(generateArray<glGenVertexArrays>()),
+		disc_vao(generateArray<glGenVertexArrays>()),
+		disc_instances_vao(generateArray<glGenVertexArrays>())
+{
+	// Attribute pointers are set by `flush_batch` as the vertices offset in the stream buffer changes
+	const GLuint indices_buf = Stream_buffer::indices().get_buffer_name();
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_vertex_array(batch_vao);
+	glEnableVertexAttribArray(Renderer::vertex_pos_attr_loc);
+	glEnableVertexAttribArray(Renderer::vertex_uv_attr_loc);
+	glEnableVertexAttribArray(Renderer::vertex_col_attr_loc);
+	gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices_buf);
+	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_NONE); // DO NOT UNBIND !!
+
+	// Discs: the instance attribute pointers are set by `discs`
+	const GLuint circles_buf = Circle_lods::get().get_buffer_name();
+	for (GLuint vao: {disc_vao, disc_instances_vao}) {
+		gl_state.bind_vertex_array(vao);
+		gl_state.bind_buffer(GL_ARRAY_BUFFER, circles_buf);
+		glEnableVertexAttribArray(Renderer::vertex_pos_attr_loc);
+		glVertexAttribPointer(Renderer::vertex_pos_attr_loc, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	}
+	glEnableVertexAttribArray(Renderer::instance_pos_scale_attr_loc);
+	glEnableVertexAttribArray(Renderer::instance_tint_attr_loc);
+	glVertexAttribDivisor(Renderer::instance_pos_scale_attr_loc, 1);
+	glVertexAttribDivisor(Renderer::instance_tint_attr_loc, 1);
+
+	check_gl_error("Blitter::ctor");
+}
+
+Blitter::~Blitter()
+{
+	Gl_state& gl_state = Gl_state::get();
+	for (GLuint vao: {batch_vao, disc_vao, disc_instances_vao}) {
+		glDeleteVertexArrays(1, &vao);
+		gl_state.deleted_vertex_array(vao);
+	}
+}
+
+static void apply_blend_mode(Blend_mode mode)
+{
+	switch (mode) {
+		case Blend_mode::alpha:    glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); break;
+		case Blend_mode::additive: glEnable(GL_BLEND); glBlendFunc(GL_SRC_ALPHA, GL_ONE); break;
+		case Blend_mode::opaque:   glDisable(GL_BLEND); break;
+	}
+}
+
+bool Blitter::Batch_state::operator<(const Batch_state& other) const
+{
+	return std::tie(layer, blend, prim_type, texture)
+	     < std::tie(other.layer, other.blend, other.prim_type, other.texture);
+}
+
+bool Blitter::Batch_state::operator==(const Batch_state& other) const
+{
+	return std::tie(layer, blend, prim_type, texture)
+	    == std::tie(other.layer, other.blend, other.prim_type, other.texture);
+}
+
+void Blitter::set_batching(bool enable)
+{
+	if (batching && !enable) {
+		flush_batch();
+	}
+	batching = enable;
+}
+
+void Blitter::set_blend_mode(Blend_mode mode)
+{
+	blend_mode = mode;
+	if (!batching) {
+		apply_blend_mode(mode);
+	}
+}
+
+// Appends the indices to draw `count` vertices starting at `base` using `draw_mode` as a list of independent primitives
+// returns the primitive type of the list (GL_TRIANGLES, GL_LINES or GL_POINTS)
+static GLenum append_list_indices(std::vector<GLuint>& indices, GLuint base, GLuint count, GLenum draw_mode)
+{
+	switch (draw_mode) {
+		case GL_TRIANGLES:
+			for (GLuint it = 0; it < count - count % 3; it++) indices.push_back(base + it);
+			return GL_TRIANGLES;
+		case GL_TRIANGLE_FAN:
+			for (GLuint it = 1; it + 1 < count; it++) indices.insert(indices.end(), {base, base + it, base + it + 1});
+			return GL_TRIANGLES;
+		case GL_TRIANGLE_STRIP:
+			for (GLuint it = 0; it + 2 < count; it++) {
+				if (it % 2 == 0) indices.insert(indices.end(), {base + it, base + it + 1, base + it + 2});
+				else indices.insert(indices.end(), {base + it + 1, base + it, base + it + 2}); // keep the winding
+			}
+			return GL_TRIANGLES;
+		case GL_LINES:
+			for (GLuint it = 0; it < count - count % 2; it++) indices.push_back(base + it);
+			return GL_LINES;
+		case GL_LINE_STRIP:
+		case GL_LINE_LOOP:
+			for (GLuint it = 0; it + 1 < count; it++) indices.insert(indices.end(), {base + it, base + it + 1});
+			if (draw_mode == GL_LINE_LOOP && count > 2) indices.insert(indices.end(), {base + count - 1, base});
+			return GL_LINES;
+		default: // GL_POINTS
+			for (GLuint it = 0; it < count; it++) indices.push_back(base + it);
+			return GL_POINTS;
+	}
+}
+
+GLuint Blitter::push_batch_vertices(const GLfloat* xy, GLsizei vx_count, const glm::mat4& model_m4, const glm::mat3& tex_m3, const glm::vec4& tint)
+{
+	const glm::u8vec4 colour(glm::clamp(tint, 0.f, 1.f) * 255.f + .5f);
+	const auto base = static_cast<GLuint>(batch_vertices.size());
+	for (GLsizei it = 0; it < vx_count; it++) {
+		const glm::vec2 vx(xy[it * 2], xy[it * 2 + 1]);
+		const glm::vec4 pos = model_m4 * glm::vec4(vx, 0.f, 1.f);
+		const glm::vec3 uv = tex_m3 * glm::vec3(vx, 1.f);
+		batch_vertices.push_back({glm::vec2(pos), glm::vec2(uv), colour});
+	}
+	return base;
+}
+
+void Blitter::queue_indexed_triangles(const GLfloat* xy, GLsizei vx_count, const std::vector<GLuint>& indices, const glm::mat4& model_m4, const glm::vec4& tint)
+{
+	const GLuint base = push_batch_vertices(xy, vx_count, model_m4, glm::mat3(1.f), tint);
+
+	const auto first_index = static_cast<GLuint>(batch_indices.size());
+	for (GLuint index: indices) {
+		batch_indices.push_back(base + index);
+	}
+
+	batch_commands.push_back({{current_layer, blend_mode, GL_TRIANGLES, GL_NONE}, first_index, static_cast<GLuint>(indices.size())});
+	stats.submitted_draws++;
+}
+
+void Blitter::queue_vertices(const GLfloat* xy, GLsizei vx_count, GLenum draw_mode, GLuint texture,
+                             const glm::mat4& model_m4, const glm::mat3& tex_m3, const glm::vec4& tint)
+{
+	const GLuint base = push_batch_vertices(xy, vx_count, model_m4, tex_m3, tint);
+
+	const auto first_index = static_cast<GLuint>(batch_indices.size());
+	const GLenum prim_type = append_list_indices(batch_indices, base, vx_count, draw_mode);
+
+	batch_commands.push_back({{current_layer, blend_mode, prim_type, texture}, first_index, static_cast<GLuint>(batch_indices.size()) - first_index});
+	stats.submitted_draws++;
+}
+
+void Blitter::flush_batch()
+{
+	if (batch_commands.empty()) {
+		return;
+	}
+	PROFILE_SCOPE("Blitter::flush_batch");
+
+	// The submission order is kept between draws of the same state (first_index grows with it),
+	// not a stable_sort: it allocates a temporary buffer
+	std::sort(batch_commands.begin(), batch_commands.end(), [](const Batch_command& a, const Batch_command& b) {
+		return a.state < b.state || (a.state == b.state && a.first_index < b.first_index);
+	});
+
+	Frame_vector<GLuint> sorted_indices;
+	sorted_indices.reserve(batch_indices.size());
+	for (const Batch_command& cmd: batch_commands) {
+		auto first = batch_indices.cbegin() + cmd.first_index;
+		sorted_indices.insert(sorted_indices.end(), first, first + cmd.index_count);
+	}
+
+	Stream_buffer& vx_stream = Stream_buffer::vertices();
+	const GLintptr vx_offset = vx_stream.push(batch_vertices);
+	const GLintptr idx_offset = Stream_buffer::indices().push(sorted_indices);
+
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_vertex_array(batch_vao);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, vx_stream.get_buffer_name());
+	glVertexAttribPointer(Renderer::vertex_pos_attr_loc, 2, GL_FLOAT, GL_FALSE, sizeof(Batch_vertex), reinterpret_cast<const void*>(vx_offset + offsetof(Batch_vertex, pos)));
+	glVertexAttribPointer(Renderer::vertex_uv_attr_loc, 2, GL_FLOAT, GL_FALSE, sizeof(Batch_vertex), reinterpret_cast<const void*>(vx_offset + offsetof(Batch_vertex, uv)));
+	glVertexAttribPointer(Renderer::vertex_col_attr_loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Batch_vertex), reinterpret_cast<const void*>(vx_offset + offsetof(Batch_vertex, colour)));
+
+	GLuint first_index = 0;
+	for (size_t it = 0; it < batch_commands.size();) {
+		const Batch_state state = batch_commands[it].state;
+		GLuint index_count = 0;
+		for (; it < batch_commands.size() && batch_commands[it].state == state; it++) {
+			index_count += batch_commands[it].index_count;
+		}
+
+		// Vertices are already transformed and tinted
+		const Renderer& program = (state.texture != GL_NONE) ? batch_textured_renderer : batch_renderer;
+		program.use_program();
+		program.set_model_matrix(glm::mat4(1.f));
+		program.set_texture_matrix(glm::mat3(1.f));
+		program.set_tint_colour(glm::vec4(1.f));
+
+		apply_blend_mode(state.blend);
+		if (state.texture != GL_NONE) {
+			gl_state.bind_texture(state.texture, Renderer::texture_unit_name);
+		}
+
+		gl_state.draw_elements(state.prim_type, index_count, GL_UNSIGNED_INT, reinterpret_cast<const void*>(idx_offset + first_index * sizeof(GLuint)));
+		first_index += index_count;
+		stats.issued_draws++;
+	}
+
+	apply_blend_mode(blend_mode);
+
+	stats.vertices += batch_vertices.size();
+	batch_vertices.clear();
+	batch_indices.clear();
+	batch_commands.clear();
+}
+
+void Blitter::flush()
+{
+	flush_batch();
+	last_stats = stats;
+	stats = {};
+
+	// Forget the polygons not drawn for a few seconds
+	constexpr unsigned max_unused_frames = 300;
+	if (++frame % 60 == 0) {
+		for (auto it = triangulations.begin(); it != triangulations.end();) {
+			it = (frame - it->second.last_used_frame > max_unused_frames) ? triangulations.erase(it) : std::next(it);
+		}
+	}
+}
+
+void Blitter::blit(const Texture& tex, const glm::mat4& model_matrix, const glm::mat3& texture_matrix, const glm::vec4& tint)
+{
+	if (batching) {
+		queue_vertices(plane_xy, plane_vx_count, GL_TRIANGLE_FAN, tex.get_texture_name(), model_matrix, texture_matrix, tint);
+		return;
+	}
+
+	Gl_state::get().bind_texture(tex.get_texture_name(), Renderer::texture_unit_name);
+	textured_renderer.use_program();
+
+	textured_renderer.set_model_matrix(model_matrix);
+	textured_renderer.set_texture_matrix(texture_matrix);
+
+	textured_renderer.set_tint_colour(tint);
 
 	plane.draw(GL_TRIANGLE_FAN);
+	stats.submitted_draws++;
+	stats.issued_draws++;
 }
 
-void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, glm::vec4 tint) const
+void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, glm::vec4 tint)
 {
 	glm::mat4 model_m4 = glm::translate(glm::mat4(1.), glm::vec3(dst_pos, 0))
 	                   * glm::scale(glm::mat4(1.), glm::vec3(tex.get_dimensions(), 0));
@@ -49,7 +375,7 @@ void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, glm::vec4 tint) const
 	blit(tex, model_m4, tex_m3, tint);
 }
 
-void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, float angle, glm::vec4 tint) const
+void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, float angle, glm::vec4 tint)
 {
 	glm::mat4 model_m4 = glm::translate(glm::mat4(1.), glm::vec3(dst_pos + tex.get_dimensions()/2.f, 0))
 	                   * glm::rotate(glm::mat4(1.), angle, glm::vec3(0, 0, 1))
@@ -62,7 +388,7 @@ void Blitter::blit(const Texture& tex, glm::vec2 dst_pos, float angle, glm::vec4
 void Blitter::blit(const Texture& tex,
                    glm::vec2 src_pos, glm::vec2 src_dim,
                    glm::vec2 dst_pos, glm::vec2 dst_dim,
-                   glm::vec2 center, float angle, glm::vec4 tint) const
+                   glm::vec2 center, float angle, glm::vec4 tint)
 {
 	glm::mat4 model_m4 = glm::translate(glm::mat4(1.), glm::vec3(dst_pos, 0))
 	                   * glm::rotate(glm::mat4(1.), angle, glm::vec3(0, 0, 1))
@@ -73,6 +399,18 @@ void Blitter::blit(const Texture& tex,
 	blit(tex, model_m4, tex_m3, tint);
 }
 
+void Blitter::blit(const Atlas_region& region,
+                   glm::vec2 dst_pos, glm::vec2 dst_dim,
+                   glm::vec2 center, float angle, glm::vec4 tint)
+{
+	blit(*region.texture, region.pos, region.dim, dst_pos, dst_dim, center, angle, tint);
+}
+
+void Blitter::blit(const Atlas_region& region, glm::vec2 dst_pos, glm::vec4 tint)
+{
+	blit(*region.texture, region.pos, region.dim, dst_pos, region.dim, {0, 0}, 0.f, tint);
+}
+
 static inline glm::mat4 compute_rect_model_m4(const glm::vec2& pos, const glm::vec2& dim, float angle)
 {
 	return glm::translate(glm::mat4(1.), glm::vec3(pos + dim/2.f, 0))
@@ -81,124 +419,311 @@ static inline glm::mat4 compute_rect_model_m4(const glm::vec2& pos, const glm::v
 	     * glm::scale(glm::mat4(1.), glm::vec3(dim, 0));
 }
 
-void Blitter::rect(glm::vec2 pos, glm::vec2 dim, GLfloat line_thickness, glm::vec4 tint, float angle) const
+void Blitter::rect(glm::vec2 pos, glm::vec2 dim, GLfloat line_thickness, glm::vec4 tint, float angle)
 {
-	renderer.set_model_matrix(compute_rect_model_m4(pos, dim, angle));
-	renderer.set_has_texture(false);
-	renderer.set_tint_colour(tint);
-	glLineWidth(line_thickness);
-	plane.draw(GL_LINE_LOOP);
+	draw_lines(plane_xy, plane_vx_count, GL_LINE_LOOP, line_thickness, compute_rect_model_m4(pos, dim, angle), tint);
 }
 
-void Blitter::rect_filled(glm::vec2 pos, glm::vec2 dim, glm::vec4 tint, float angle) const
+void Blitter::rect_filled(glm::vec2 pos, glm::vec2 dim, glm::vec4 tint, float angle)
 {
-	renderer.set_model_matrix(compute_rect_model_m4(pos, dim, angle));
-	renderer.set_has_texture(false);
-	renderer.set_tint_colour(tint);
+	if (batching) {
+		queue_vertices(plane_xy, plane_vx_count, GL_TRIANGLE_FAN, GL_NONE, compute_rect_model_m4(pos, dim, angle), glm::mat3(1.f), tint);
+		return;
+	}
+
+	flat_renderer.use_program();
+	flat_renderer.set_model_matrix(compute_rect_model_m4(pos, dim, angle));
+	flat_renderer.set_tint_colour(tint);
 	plane.draw(GL_TRIANGLE_FAN);
+	stats.submitted_draws++;
+	stats.issued_draws++;
 }
 
-// If drawing lines, Set line thickness before calling this function
-void Blitter::stream_vertices(const std::vector<GLfloat>& vertices, GLenum draw_mode, glm::vec4 tint) const
+void Blitter::stream_vertices(Lib::Span<const GLfloat> vertices, GLenum draw_mode, glm::vec4 tint)
 {
-	constexpr GLint component_number = 2;
-	transfer_geometry<GL_ARRAY_BUFFER, GL_STREAM_DRAW, component_number>(Renderer::vertex_pos_attr_loc, buf_name, vertices);
-	glVertexAttrib3f(Renderer::vertex_col_attr_loc, tint.r, tint.g, tint.b); // Set the value used when that vertex attrib is disabled: do not enable!!
-	renderer.set_has_texture(false);
-	renderer.set_tint_colour(glm::vec4(1.f));
+	if (batching) {
+		queue_vertices(vertices.data(), vertices.size() / 2, draw_mode, GL_NONE, glm::mat4(1.f), glm::mat3(1.f), tint);
+		return;
+	}
 
-	glDrawArrays(draw_mode, 0, vertices.size() / component_number);
+	constexpr GLint component_number = 2;
+	Stream_buffer& vx_stream = Stream_buffer::vertices();
+	const GLintptr offset = vx_stream.push(vertices.data(), vertices.size_bytes());
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_vertex_array(GL_NONE); // client side attributes of the default VAO
+	glEnableVertexAttribArray(Renderer::vertex_pos_attr_loc);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, vx_stream.get_buffer_name());
+	glVertexAttribPointer(Renderer::vertex_pos_attr_loc, component_number, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(offset));
+	flat_renderer.use_program();
+	flat_renderer.set_tint_colour(tint);
+
+	gl_state.draw_arrays(draw_mode, 0, vertices.size() / component_number);
 
-	glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
 	glDisableVertexAttribArray(Renderer::vertex_pos_attr_loc);
+	stats.submitted_draws++;
+	stats.issued_draws++;
 }
 
-void Blitter::polyline(const vector<GLfloat>& vertices, GLfloat line_thickness, glm::vec4 tint) const
+// Streams vertices transformed by model_m4
+void Blitter::draw_vertices(Lib::Span<const GLfloat> vertices, GLenum draw_mode, const glm::mat4& model_m4, const glm::vec4& tint)
 {
-	glLineWidth(line_thickness);
-	renderer.set_model_matrix(glm::mat4(1.f));
-	stream_vertices(vertices, GL_LINE_STRIP, tint);
+	if (batching) {
+		queue_vertices(vertices.data(), vertices.size() / 2, draw_mode, GL_NONE, model_m4, glm::mat3(1.f), tint);
+		return;
+	}
+
+	flat_renderer.use_program();
+	flat_renderer.set_model_matrix(model_m4);
+	stream_vertices(vertices, draw_mode, tint);
 }
 
-void Blitter::polygon(const vector<GLfloat>& vertices, GLfloat line_thickness, glm::vec4 tint) const
+static void push_triangle(std::vector<GLfloat>& triangles, glm::vec2 a, glm::vec2 b, glm::vec2 c)
 {
-	glLineWidth(line_thickness);
-	renderer.set_model_matrix(glm::mat4(1.f));
-	stream_vertices(vertices, GL_LINE_LOOP, tint);
+	triangles.insert(triangles.end(), {a.x, a.y, b.x, b.y, c.x, c.y});
 }
 
-void Blitter::polygon_filled(const vector<GLfloat>& vertices, glm::vec4 tint) const
+// Triangle fan around `center`, from `center + from` rotated by `angle` radians (signed)
+static void push_arc(std::vector<GLfloat>& triangles, glm::vec2 center, glm::vec2 from, float angle, float half_thickness)
 {
-	// Solution that only works with convex polygons:
-	// find the barycenter of all points in vertices, and prepend vertices with the points
-	// then render using GL_TRIANGLE_FAN
-	renderer.set_model_matrix(glm::mat4(1.f));
-	polygon(vertices, 1.f, tint); // TODO
+	// Angle step that keeps the chords within a quarter of pixel of the arc
+	const float max_step = half_thickness > .25f ? 2.f * std::acos(1.f - .25f / half_thickness) : PI;
+	const int steps = std::max(1, static_cast<int>(std::ceil(std::abs(angle) / max_step)));
+	glm::vec2 previous = from;
+	for (int it = 1; it <= steps; it++) {
+		const float a = angle * static_cast<float>(it) / static_cast<float>(steps);
+		const glm::vec2 next(from.x * cosf(a) - from.y * sinf(a), from.x * sinf(a) + from.y * cosf(a));
+		push_triangle(triangles, center, center + previous, center + next);
+		previous = next;
+	}
 }
 
-// generate `vertices_number` vertices around (0, 0), radius=1.0; `vertices` must be pre-allocated
-// STRIDE: how many float to skip at the begin of vertices
-// CLOSE: close the circle: adds 2 extra floats at the end
-//   (same coords as the first generated vertex, vertices.size must be at least `vertices_number + 2`)
-template<int STRIDE = 0, bool CLOSE = false>
-static inline void generate_circle_vertices(std::vector<GLfloat>& vertices, int vertices_number, float angle)
+// Fills the outer side of the corner at `point` between the incoming direction d0 and the outgoing direction d1
+static void push_join(std::vector<GLfloat>& triangles, glm::vec2 point, glm::vec2 d0, glm::vec2 d1, float half_thickness, Line_join join)
 {
-	int it = 0;
-	for (; it<vertices_number; it++) {
-		vertices[STRIDE + it*2]     = cosf(angle * static_cast<float>(it));
-		vertices[STRIDE + it*2 + 1] = sinf(angle * static_cast<float>(it));
+	constexpr float miter_limit = 4.f;
+	const float cross = d0.x * d1.y - d0.y * d1.x;
+	if (std::abs(cross) < 1e-4f && glm::dot(d0, d1) > 0.f) {
+		return; // straight
 	}
-	if constexpr (CLOSE) {
-		vertices[STRIDE + it*2]     = vertices[STRIDE];
-		vertices[STRIDE + it*2 + 1] = vertices[STRIDE + 1];
+	const float side = cross > 0.f ? -1.f : 1.f; // the outer side is on the right of a left turn
+	const glm::vec2 n0 = glm::vec2(-d0.y, d0.x) * half_thickness * side;
+	const glm::vec2 n1 = glm::vec2(-d1.y, d1.x) * half_thickness * side;
+
+	switch (join) {
+		case Line_join::miter: {
+			// |n0 + n1| = 2 * half_thickness * cos(half the angle between the normals)
+			const glm::vec2 bisector = n0 + n1;
+			const float length2 = glm::dot(bisector, bisector);
+			if (length2 * miter_limit * miter_limit > 4.f * half_thickness * half_thickness) {
+				const glm::vec2 tip = point + bisector * (2.f * half_thickness * half_thickness / length2);
+				push_triangle(triangles, point, point + n0, tip);
+				push_triangle(triangles, point, tip, point + n1);
+				break;
+			}
+			[[fallthrough]];
+		}
+		case Line_join::bevel:
+			push_triangle(triangles, point, point + n0, point + n1);
+			break;
+		case Line_join::round:
+			push_arc(triangles, point, n0, std::atan2(n0.x * n1.y - n0.y * n1.x, glm::dot(n0, n1)), half_thickness);
+			break;
 	}
 }
 
-// computes the ideal number of vertices (and angle) for the given radius so the circle looks smooth
-template<bool LINEAR = false>
-static inline void ideal_vertices_for_radius(float radius, int* prim_gen_number, float* angle)
+// `direction` points outwards
+static void push_cap(std::vector<GLfloat>& triangles, glm::vec2 point, glm::vec2 direction, float half_thickness, Line_cap cap)
 {
-	constexpr float min_vx_number = 5.f;   // generate at least this number of vertices
-	constexpr float   coefficient = 6.f;   // the bigger the smoother (the slower)
-	constexpr float  start_growth = 4.f;   // minimum radius for which this function begins to generate more than `min_vx_number` vertices
+	const glm::vec2 normal = glm::vec2(-direction.y, direction.x) * half_thickness;
+	switch (cap) {
+		case Line_cap::butt:
+			break;
+		case Line_cap::square: {
+			const glm::vec2 extent = direction * half_thickness;
+			push_triangle(triangles, point + normal, point - normal, point - normal + extent);
+			push_triangle(triangles, point + normal, point - normal + extent, point + normal + extent);
+			break;
+		}
+		case Line_cap::round:
+			push_arc(triangles, point, normal, -PI, half_thickness);
+			break;
+	}
+}
 
-	if constexpr (LINEAR) {
-		*prim_gen_number = std::ceil(std::max(0.f, radius - start_growth) * coefficient + min_vx_number); // best coefficient is .5
+// Expands a polyline into a triangle list: a quad per segment, plus joins and caps (points must not repeat)
+static void expand_polyline(std::vector<GLfloat>& triangles, const glm::vec2* points, size_t count, bool closed,
+                            float half_thickness, Line_join join, Line_cap cap)
+{
+	if (count < 2) {
+		return;
+	}
+	const size_t segment_count = closed ? count : count - 1;
+	auto direction = [&](size_t segment) { return glm::normalize(points[(segment + 1) % count] - points[segment]); };
+
+	for (size_t it = 0; it < segment_count; it++) {
+		const glm::vec2 a = points[it];
+		const glm::vec2 b = points[(it + 1) % count];
+		const glm::vec2 d = direction(it);
+		const glm::vec2 n = glm::vec2(-d.y, d.x) * half_thickness;
+		push_triangle(triangles, a + n, a - n, b - n);
+		push_triangle(triangles, a + n, b - n, b + n);
+	}
+
+	for (size_t it = closed ? 0 : 1; it < (closed ? count : count - 1); it++) {
+		push_join(triangles, points[it], direction((it + count - 1) % count), direction(it), half_thickness, join);
+	}
+
+	if (!closed) {
+		push_cap(triangles, points[0], -direction(0), half_thickness, cap);
+		push_cap(triangles, points[count - 1], direction(count - 2), half_thickness, cap);
+	}
+}
+
+void Blitter::draw_lines(const GLfloat* xy, GLsizei vx_count, GLenum draw_mode, GLfloat line_thickness, const glm::mat4& model_m4, const glm::vec4& tint)
+{
+	PROFILE_SCOPE("Blitter::draw_lines");
+	// Expanded in screen space so the thickness does not scale with the model matrix
+	Frame_vector<glm::vec2> line_points;
+	line_points.reserve(vx_count);
+	for (GLsizei it = 0; it < vx_count; it++) {
+		line_points.emplace_back(model_m4 * glm::vec4(xy[it * 2], xy[it * 2 + 1], 0.f, 1.f));
+	}
+
+	const float half_thickness = line_thickness / 2.f;
+	line_triangles.clear();
+	if (draw_mode == GL_LINES) {
+		for (size_t it = 0; it + 1 < line_points.size(); it += 2) {
+			if (line_points[it] != line_points[it + 1]) {
+				expand_polyline(line_triangles, &line_points[it], 2, false, half_thickness, line_join, line_cap);
+			}
+		}
 	}
 	else {
-		float variable = std::max(0.f, radius - start_growth);
-		*prim_gen_number = std::ceil(std::log2(1.f + variable) * coefficient + min_vx_number); // best coefficient is 6
+		line_points.erase(std::unique(line_points.begin(), line_points.end()), line_points.end());
+		const bool closed = draw_mode == GL_LINE_LOOP && line_points.size() > 2;
+		if (closed && line_points.front() == line_points.back()) {
+			line_points.pop_back();
+		}
+		expand_polyline(line_triangles, line_points.data(), line_points.size(), closed, half_thickness, line_join, line_cap);
 	}
 
-	*angle = PI_2 / static_cast<float>(*prim_gen_number);
+	if (line_triangles.empty()) {
+		return;
+	}
+	draw_vertices(line_triangles, GL_TRIANGLES, glm::mat4(1.f), tint);
+}
+
+void Blitter::line(glm::vec2 from, glm::vec2 to, GLfloat line_thickness, glm::vec4 tint)
+{
+	const GLfloat vertices[] = { from.x, from.y, to.x, to.y };
+	draw_lines(vertices, 2, GL_LINES, line_thickness, glm::mat4(1.f), tint);
+}
+
+void Blitter::lines(Lib::Span<const GLfloat> segments, GLfloat line_thickness, glm::vec4 tint)
+{
+	draw_lines(segments.data(), segments.size() / 2, GL_LINES, line_thickness, glm::mat4(1.f), tint);
+}
+
+void Blitter::polyline(Lib::Span<const GLfloat> vertices, GLfloat line_thickness, glm::vec4 tint)
+{
+	draw_lines(vertices.data(), vertices.size() / 2, GL_LINE_STRIP, line_thickness, glm::mat4(1.f), tint);
+}
+
+void Blitter::polygon(Lib::Span<const GLfloat> vertices, GLfloat line_thickness, glm::vec4 tint)
+{
+	draw_lines(vertices.data(), vertices.size() / 2, GL_LINE_LOOP, line_thickness, glm::mat4(1.f), tint);
+}
+
+// FNV-1a of the coordinates, the high bit is set to not collide with handles
+static uint64_t hash_vertices(Lib::Span<const GLfloat> vertices)
+{
+	return hash_bytes(vertices.data(), vertices.size_bytes()) | (uint64_t(1) << 63);
+}
+
+void Blitter::polygon_filled(Lib::Span<const GLfloat> vertices, glm::vec4 tint)
+{
+	polygon_filled(hash_vertices(vertices), vertices, glm::mat4(1.f), tint);
 }
 
-void Blitter::circle(glm::vec2 center, float radius, GLfloat line_thickness, glm::vec4 tint) const
+void Blitter::polygon_filled(uint64_t handle, Lib::Span<const GLfloat> vertices, const glm::mat4& model_m4, glm::vec4 tint)
 {
-	int vx_count;
-	float angle;
-	ideal_vertices_for_radius(radius, &vx_count, &angle);
-	std::vector<GLfloat> vertices(2 * vx_count);
-	generate_circle_vertices(vertices, vx_count, angle);
+	const size_t vx_count = vertices.size() / 2;
+	Triangulation& triangulation = triangulations[handle];
+	if (!triangulation.attempted || triangulation.vx_count != vx_count) {
+		triangulation.indices = triangulate_polygon(vertices.data(), vx_count);
+		triangulation.vx_count = vx_count;
+		triangulation.attempted = true;
+	}
+	triangulation.last_used_frame = frame;
+	if (triangulation.indices.empty()) {
+		return;
+	}
+
+	// Indexed triangles only exist in batches: a batch of one draw when not batching
+	queue_indexed_triangles(vertices.data(), vx_count, triangulation.indices, model_m4, tint);
+	if (!batching) {
+		flush_batch();
+	}
+}
 
+void Blitter::circle(glm::vec2 center, float radius, GLfloat line_thickness, glm::vec4 tint)
+{
+	const int vx_count = ideal_vertices_for_radius(radius);
 	ImGui::Text("Circle: %2d vertices for radius=%f", vx_count, radius);
 
-	renderer.set_model_matrix(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(center, 0.f)), glm::vec3(radius, radius, 1.f)));
-	glLineWidth(line_thickness);
-	stream_vertices(vertices, GL_LINE_LOOP, tint);
+	const GLfloat* ring = Circle_lods::get().get_xy(vx_count) + 2;
+	draw_lines(ring, vx_count, GL_LINE_LOOP, line_thickness, glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(center, 0.f)), glm::vec3(radius, radius, 1.f)), tint);
 }
 
-void Blitter::disc(glm::vec2 center, float radius, glm::vec4 tint) const
+void Blitter::disc(glm::vec2 center, float radius, glm::vec4 tint)
 {
-	int vx_count;
-	float angle;
-	ideal_vertices_for_radius(radius, &vx_count, &angle);
-	std::vector<GLfloat> vertices(2 * vx_count + 2 + 2); // + STRIDE + CLOSE
-	vertices[0] = vertices[1] = 0.f;
-	generate_circle_vertices<2, true>(vertices, vx_count, angle);
+	const int vx_count = ideal_vertices_for_radius(radius);
+	const Circle_lods& lods = Circle_lods::get();
+	const glm::mat4 model_m4 = glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(center, 0.f)), glm::vec3(radius, radius, 1.f));
+
+	if (batching) {
+		queue_vertices(lods.get_xy(vx_count), vx_count + 2, GL_TRIANGLE_FAN, GL_NONE, model_m4, glm::mat3(1.f), tint);
+		return;
+	}
+
+	Gl_state::get().bind_vertex_array(disc_vao);
+	flat_renderer.use_program();
+	flat_renderer.set_model_matrix(model_m4);
+	flat_renderer.set_tint_colour(tint);
+	Gl_state::get().draw_arrays(GL_TRIANGLE_FAN, lods.get_first(vx_count), vx_count + 2);
+	stats.submitted_draws++;
+	stats.issued_draws++;
+}
 
-	renderer.set_model_matrix(glm::scale(glm::translate(glm::mat4(1.f), glm::vec3(center, 0.f)), glm::vec3(radius, radius, 1.f)));
-	stream_vertices(vertices, GL_TRIANGLE_FAN, tint);
+void Blitter::discs(Lib::Span<const Disc_instance> instances, float lod_radius)
+{
+	if (instances.empty()) {
+		return;
+	}
+	flush_batch(); // keeps the submission order
+
+	if (lod_radius <= 0.f) {
+		for (const Disc_instance& instance: instances) {
+			lod_radius = std::max(lod_radius, instance.radius);
+		}
+	}
+	const int vx_count = ideal_vertices_for_radius(lod_radius);
+
+	Stream_buffer& vx_stream = Stream_buffer::vertices();
+	const GLintptr offset = vx_stream.push(instances.data(), instances.size_bytes());
+
+	Gl_state& gl_state = Gl_state::get();
+	discs_renderer.use_program();
+	discs_renderer.set_tint_colour(glm::vec4(1.f)); // the instances are tinted
+	gl_state.bind_vertex_array(disc_instances_vao);
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, vx_stream.get_buffer_name());
+	glVertexAttribPointer(Renderer::instance_pos_scale_attr_loc, 3, GL_FLOAT, GL_FALSE, sizeof(Disc_instance), reinterpret_cast<const void*>(offset + offsetof(Disc_instance, center)));
+	glVertexAttribPointer(Renderer::instance_tint_attr_loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Disc_instance), reinterpret_cast<const void*>(offset + offsetof(Disc_instance, colour)));
+	apply_blend_mode(blend_mode);
+
+	gl_state.draw_arrays_instanced(GL_TRIANGLE_FAN, Circle_lods::get().get_first(vx_count), vx_count + 2, static_cast<GLsizei>(instances.size()));
+	stats.submitted_draws++;
+	stats.issued_draws++;
 }
 
 Blitter::Plane::Plane():
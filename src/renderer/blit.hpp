@@ -23,57 +23,217 @@
 #include "renderer.hpp"
 #include "mesh.hpp"
 #include "texture.hpp"
+#include "atlas.hpp"
+#include "../lib/span.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
 
 namespace Engine::Renderer {
 
+enum class Blend_mode { alpha, additive, opaque };
+
+// Shape of the corners of polylines and polygons, a miter longer than 4 times the half thickness falls back to bevel
+enum class Line_join { miter, bevel, round };
+// Shape of the ends of polylines and lines
+enum class Line_cap { butt, square, round };
+
+// An instance of `Blitter::discs`, matches the instance attributes of the Renderer::instanced_2d feature
+struct Disc_instance {
+	glm::vec2 center;
+	float radius;
+	glm::u8vec4 colour;
+};
+
+// Draw call counters, see `Blitter::get_stats()`
+struct Batch_stats {
+	unsigned submitted_draws = 0; // draws requested by the user (one draw call each without batching)
+	unsigned issued_draws = 0;    // draw calls actually issued
+	unsigned vertices = 0;        // vertices sent in batches
+};
+
 // A texture blitter to use with the Camera2D
 // Use screen coordinates in pixels absolute (see Camera2D)
+// Transient buffers come from the Frame_arena: use from the main thread
 class Blitter {
 public:
-	explicit Blitter(const Renderer &renderer);
-	~Blitter() = default;
+	// The programs are picked from Renderer::get
+	Blitter();
+	~Blitter();
 	Blitter(const Blitter&) = delete;
 	Blitter(Blitter&&) = delete;
 	Blitter& operator=(const Blitter&) = delete;
 	Blitter& operator=(Blitter&&) = delete;
 
+	// Batching mode: draws are transformed on the CPU and queued, then sorted by layer/state and
+	// issued in as few draw calls as possible by `flush()`
+	// Disabling batching flushes the pending draws
+	void set_batching(bool enable);
+	[[nodiscard]] bool is_batching() const { return batching; }
+
+	// Batched draws are sorted by layer first (lower layers are drawn first), then by state.
+	// Within a layer the submission order is NOT preserved, put overlapping shapes on different layers
+	void set_layer(int layer) { current_layer = layer; }
+
+	// Blending applied to the next draws (immediately if not batching)
+	void set_blend_mode(Blend_mode mode);
+
+	// Joins and caps of the next outlines
+	void set_line_style(Line_join join, Line_cap cap) { line_join = join; line_cap = cap; }
+
+	// Issue pending batched draws, call it once at the end of each frame (even when not batching, to update the stats)
+	void flush();
+
+	// Counters of the last flushed frame
+	[[nodiscard]] const Batch_stats& get_stats() const { return last_stats; }
+
 	// Base blit function, used by more user friendly functions below
-	void blit(const Texture& tex, const glm::mat4& model_matrix, const glm::mat3& texture_matrix, const glm::vec4& tint = glm::vec4(1.)) const;
+	void blit(const Texture& tex, const glm::mat4& model_matrix, const glm::mat3& texture_matrix, const glm::vec4& tint = glm::vec4(1.));
 
 	// Draw texture at the given coordinate
-	void blit(const Texture& tex, glm::vec2 dst_pos, glm::vec4 tint = glm::vec4(1.)) const;
+	void blit(const Texture& tex, glm::vec2 dst_pos, glm::vec4 tint = glm::vec4(1.));
 
 	// Draw texture rotated on its center
-	void blit(const Texture& tex, glm::vec2 dst_pos, float angle, glm::vec4 tint = glm::vec4(1.)) const;
+	void blit(const Texture& tex, glm::vec2 dst_pos, float angle, glm::vec4 tint = glm::vec4(1.));
 
 	// Draw region of a texture, rotated around a given point, at the specified destination
 	void blit(const Texture& tex,
 	          glm::vec2 src_pos, glm::vec2 src_dim,
 	          glm::vec2 dst_pos, glm::vec2 dst_dim,
-	          glm::vec2 center = {0,0}, float angle = 0.f, glm::vec4 tint = glm::vec4(1.)) const;
+	          glm::vec2 center = {0,0}, float angle = 0.f, glm::vec4 tint = glm::vec4(1.));
 
-	// Draw a rectangle with the given colour and line thickness, rotated on its center
-	void rect(glm::vec2 pos, glm::vec2 dim, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.), float angle = 0.f) const;
+	// Draw an atlas region, rotated around a given point, at the specified destination
+	void blit(const Atlas_region& region,
+	          glm::vec2 dst_pos, glm::vec2 dst_dim,
+	          glm::vec2 center = {0,0}, float angle = 0.f, glm::vec4 tint = glm::vec4(1.));
 
-	// Draw a rectangle filled with the given colour, rotated on its center
-	void rect_filled(glm::vec2 pos, glm::vec2 dim, glm::vec4 tint = glm::vec4(1.), float angle = 0.f) const;
+	// Draw an atlas region at the given coordinate, in its original dimensions
+	void blit(const Atlas_region& region, glm::vec2 dst_pos, glm::vec4 tint = glm::vec4(1.));
 
-	// Stream vertices (does not set the model matrix)
-	void stream_vertices(const std::vector<GLfloat>& vertices, GLenum draw_mode, glm::vec4 tint = glm::vec4(1.)) const;
+	// Draw a rectangle with the given colour and line thickness, rotated on its center
+	void rect(glm::vec2 pos, glm::vec2 dim, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.), float angle = 0.f);
 
-	void polyline(const std::vector<GLfloat>& vertices, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.)) const;
-	void polygon(const std::vector<GLfloat>& vertices, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.)) const;
-	void polygon_filled(const std::vector<GLfloat>& vertices, glm::vec4 tint = glm::vec4(1.)) const;
-	void circle(glm::vec2 center, float radius, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.)) const;
-	void disc(glm::vec2 center, float radius, glm::vec4 tint = glm::vec4(1.)) const;
+	// Draw a rectangle filled with the given colour, rotated on its center
+	void rect_filled(glm::vec2 pos, glm::vec2 dim, glm::vec4 tint = glm::vec4(1.), float angle = 0.f);
+
+	// Stream vertices through the shared vertex Stream_buffer (does not set the model matrix, identity is used when batching)
+	// GL_LINES, GL_LINE_STRIP and GL_LINE_LOOP are drawn 1px thick, see `polyline` and `lines` for thick lines
+	void stream_vertices(Lib::Span<const GLfloat> vertices, GLenum draw_mode, glm::vec4 tint = glm::vec4(1.));
+
+	// Outlines are expanded into triangles on the CPU (line_thickness in pixels), when batching all the outlines of
+	// a layer are merged with the untextured shapes in a single draw call
+	void line(glm::vec2 from, glm::vec2 to, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.));
+	// Independent segments (x0, y0, x1, y1, ...), eg: springs of a physics debug view
+	void lines(Lib::Span<const GLfloat> segments, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.));
+	void polyline(Lib::Span<const GLfloat> vertices, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.));
+	void polygon(Lib::Span<const GLfloat> vertices, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.));
+
+	// Draw a simple polygon, concave allowed (see triangulate_polygon), its triangulation is cached by content:
+	// for static shapes in screen coordinates
+	void polygon_filled(Lib::Span<const GLfloat> vertices, glm::vec4 tint = glm::vec4(1.));
+	// Same, the triangulation is cached by `handle` (one per shape, below 2^63) and the vertices are transformed
+	// by model_m4: for moving shapes (eg: rigid bodies), the handle must be forgotten if the shape changes
+	void polygon_filled(uint64_t handle, Lib::Span<const GLfloat> vertices, const glm::mat4& model_m4, glm::vec4 tint = glm::vec4(1.));
+	void forget_polygon(uint64_t handle) { triangulations.erase(handle); }
+	// Circles and discs use precomputed unit circles, their level of detail depends on the radius
+	void circle(glm::vec2 center, float radius, GLfloat line_thickness = 1.0f, glm::vec4 tint = glm::vec4(1.));
+	void disc(glm::vec2 center, float radius, glm::vec4 tint = glm::vec4(1.));
+
+	// Draw many discs in a single instanced draw call, issued immediately (the pending batched draws are flushed first)
+	// All discs share the level of detail of `lod_radius`, or of the largest radius if 0
+	void discs(Lib::Span<const Disc_instance> instances, float lod_radius = 0.f);
 
 private:
-	const Renderer& renderer;
-	const GLuint buf_name;
+	// Vertex of the batch buffer (interleaved)
+	struct Batch_vertex {
+		glm::vec2 pos;
+		glm::vec2 uv;
+		glm::u8vec4 colour;
+	};
+
+	// Every draw that shares the same state can be merged
+	struct Batch_state {
+		int layer;
+		Blend_mode blend;
+		GLenum prim_type; // GL_TRIANGLES, GL_LINES or GL_POINTS
+		GLuint texture;   // GL_NONE if not textured
+
+		bool operator<(const Batch_state& other) const;
+		bool operator==(const Batch_state& other) const;
+		bool operator!=(const Batch_state& other) const { return !(*this == other); }
+	};
+
+	// A queued draw, refers to a range in `batch_indices`
+	struct Batch_command {
+		Batch_state state;
+		GLuint first_index;
+		GLuint index_count;
+	};
+
+	// Queue `vx_count` 2D vertices (x, y) transformed by model_m4, UVs are computed from the untransformed coordinates by tex_m3
+	void queue_vertices(const GLfloat* xy, GLsizei vx_count, GLenum draw_mode, GLuint texture,
+	                    const glm::mat4& model_m4, const glm::mat3& tex_m3, const glm::vec4& tint);
+
+	// Transform and append vertices to `batch_vertices`, returns the index of the first one
+	GLuint push_batch_vertices(const GLfloat* xy, GLsizei vx_count, const glm::mat4& model_m4, const glm::mat3& tex_m3, const glm::vec4& tint);
+
+	// Queue triangles of `vx_count` untextured 2D vertices transformed by model_m4
+	void queue_indexed_triangles(const GLfloat* xy, GLsizei vx_count, const std::vector<GLuint>& indices, const glm::mat4& model_m4, const glm::vec4& tint);
+
+	// Issue the queued draws
+	void flush_batch();
+
+	void draw_vertices(Lib::Span<const GLfloat> vertices, GLenum draw_mode, const glm::mat4& model_m4, const glm::vec4& tint);
+
+	// Expands the lines (GL_LINES, GL_LINE_STRIP or GL_LINE_LOOP) of `vx_count` vertices transformed by model_m4, then draws them
+	void draw_lines(const GLfloat* xy, GLsizei vx_count, GLenum draw_mode, GLfloat line_thickness, const glm::mat4& model_m4, const glm::vec4& tint);
+
+	// Programs
+	const Renderer& flat_renderer;     // untextured, the colour is the tint uniform
+	const Renderer& textured_renderer; // textured, tinted by the tint uniform
+	const Renderer& batch_renderer;    // untextured, vertex colours
+	const Renderer& batch_textured_renderer; // textured, vertex colours
+	const Renderer& discs_renderer;    // 2D instances
 	const struct Plane : public Static_indexed_mesh {
 		Plane();
 		~Plane() = default;
 	} plane;
+
+	// Batching
+	bool batching = false;
+	int current_layer = 0;
+	Blend_mode blend_mode = Blend_mode::alpha;
+	Line_join line_join = Line_join::miter;
+	Line_cap line_cap = Line_cap::butt;
+	std::vector<GLfloat> line_triangles; // scratch buffer of `draw_lines`
+	// Gathered until the next flush, their storage is kept
+	std::vector<Batch_vertex> batch_vertices;
+	std::vector<GLuint> batch_indices;
+	std::vector<Batch_command> batch_commands;
+	const GLuint batch_vao; // sources the shared stream buffers
+
+	// Discs
+	const GLuint disc_vao;           // sources the unit circles
+	const GLuint disc_instances_vao; // sources the unit circles and the instances in the vertex stream buffer
+
+	Batch_stats stats;
+	Batch_stats last_stats;
+
+	// Polygon triangulations by handle or content hash, evicted when unused for a while (see `flush`)
+	struct Triangulation {
+		std::vector<GLuint> indices; // empty if the polygon was rejected
+		size_t vx_count;
+		unsigned last_used_frame;
+		bool attempted; // not triangulated again until its vertex count changes, even if rejected
+	};
+	std::unordered_map<uint64_t, Triangulation> triangulations;
+	unsigned frame = 0;
 };
 
 } // namespace Engine::Renderer
@@ -0,0 +1,353 @@
+/*
+    3D Physics Simulations - Frame capture: asynchronous read back of the rendered frames
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "frame_capture.hpp"
+
+#ifndef EMSCRIPTEN
+
+#include "gl_state.hpp"
+#include "../error.hpp"
+#include "../profiler.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using std::literals::string_literals::operator""s;
+
+namespace Engine::Renderer {
+
+constexpr GLuint64 fence_timeout_ns = 1000000000;
+
+// Whether `pattern` has exactly one unsigned conversion (%u, %0Nu) and no other but %%,
+// so each frame gets its own file and snprintf is given matching arguments
+static bool is_frame_pattern(const std::string& pattern)
+{
+	unsigned conversions = 0;
+	for (size_t it = 0; it < pattern.size(); it++) {
+		if (pattern[it] != '%') {
+			continue;
+		}
+		if (++it < pattern.size() && pattern[it] == '%') {
+			continue;
+		}
+		if (it < pattern.size() && pattern[it] == '0') {
+			it++;
+		}
+		while (it < pattern.size() && pattern[it] >= '0' && pattern[it] <= '9') {
+			it++;
+		}
+		if (it == pattern.size() || pattern[it] != 'u') {
+			return false;
+		}
+		conversions++;
+	}
+	return conversions == 1;
+}
+
+Frame_capture::Frame_capture(Format format, const std::string& path, GLuint source, int width, int height,
+                             unsigned ring_size, unsigned max_queued, unsigned writer_count):
+		format(format), path(path), source(source), width(width), height(height), max_queued(std::max(max_queued, 1u)),
+		ring(std::max(ring_size, 1u))
+{
+	if (format == Format::raw) {
+		pipe = !path.empty() && path[0] == '|';
+		stream = pipe ? popen(path.c_str() + 1, "w") : std::fopen(path.c_str(), "wb");
+		if (stream == nullptr) {
+			throw std::runtime_error("Frame_capture: cannot open "s + path);
+		}
+		writer_count = 1;
+	}
+	else if (!is_frame_pattern(path)) {
+		throw Error("Frame_capture: the PNG sequence pattern needs exactly one frame number conversion (%u or %05u), and no other but %%: "s + path);
+	}
+
+	// The source may be multisampled, glReadPixels only reads single sampled framebuffers
+	glGenRenderbuffers(1, &renderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, GL_NONE);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, source);
+
+	Gl_state& gl_state = Gl_state::get();
+	for (Slot& slot: ring) {
+		glGenBuffers(1, &slot.pbo);
+		gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+		gl_state.buffer_data(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+	}
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+
+	for (unsigned it = 0; it < std::max(writer_count, 1u); it++) {
+		writers.emplace_back(&Frame_capture::writer_run, this);
+	}
+}
+
+Frame_capture::~Frame_capture()
+{
+	for (unsigned it = 0; it < ring.size(); it++) {
+		Slot& slot = ring[(next_slot + it) % ring.size()];
+		if (slot.fence != nullptr) {
+			collect(slot, true);
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	cond.notify_all();
+	for (std::thread& writer: writers) {
+		writer.join();
+	}
+	if (error) {
+		try {
+			std::rethrow_exception(error);
+		}
+		catch (const std::exception& ex) {
+			std::cerr << ex.what() << std::endl;
+		}
+	}
+
+	if (stream != nullptr) {
+		pipe ? pclose(stream) : std::fclose(stream);
+	}
+
+	Gl_state& gl_state = Gl_state::get();
+	for (Slot& slot: ring) {
+		glDeleteBuffers(1, &slot.pbo);
+		gl_state.deleted_buffer(slot.pbo);
+	}
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &renderbuffer);
+}
+
+void Frame_capture::capture()
+{
+	rethrow_error();
+
+	// Collect the read backs completed since the last frame, oldest first to keep the frames ordered
+	for (unsigned it = 0; it < ring.size(); it++) {
+		Slot& slot = ring[(next_slot + it) % ring.size()];
+		if (slot.fence == nullptr) {
+			continue;
+		}
+		GLenum res = glClientWaitSync(slot.fence, 0, 0);
+		if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+			break;
+		}
+		collect(slot, false);
+	}
+
+	// The ring is full: the GPU is more than `ring_size` frames late
+	Slot& slot = ring[next_slot];
+	if (slot.fence != nullptr) {
+		stats.stalls++;
+		collect(slot, true);
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, source);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	gl_state.read_pixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); // into the PBO: does not wait
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, source);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.frame = frame++;
+	next_slot = (next_slot + 1) % ring.size();
+	stats.captured++;
+}
+
+void Frame_capture::collect(Slot& slot, bool wait)
+{
+	if (wait) {
+		GLenum res;
+		do {
+			res = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, fence_timeout_ns);
+		} while (res == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = nullptr;
+
+	Frame out{slot.frame, {}};
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (queue.size() + writing >= max_queued) {
+			stats.stalls++;
+			done_cond.wait(lock, [this]() { return queue.size() + writing < max_queued; });
+		}
+		if (!free_buffers.empty()) {
+			out.pixels = std::move(free_buffers.back());
+			free_buffers.pop_back();
+		}
+		stats.written = written;
+	}
+	out.pixels.resize(width * height * 4);
+
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const void* src = gl_state.map_buffer_range(GL_PIXEL_PACK_BUFFER, 0, out.pixels.size(), GL_MAP_READ_BIT);
+	if (src != nullptr) {
+		std::memcpy(out.pixels.data(), src, out.pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	gl_state.bind_buffer(GL_PIXEL_PACK_BUFFER, GL_NONE);
+	if (src == nullptr) {
+		throw std::runtime_error("Frame_capture: cannot map buffer");
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(std::move(out));
+	}
+	cond.notify_one();
+}
+
+void Frame_capture::writer_run()
+{
+	PROFILE_THREAD("Frame_capture");
+	std::vector<unsigned char> scratch, compressed; // reused across frames
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		cond.wait(lock, [this]() { return quit || !queue.empty(); });
+		if (queue.empty()) {
+			return; // quit once everything is written
+		}
+		Frame out = std::move(queue.front());
+		queue.pop_front();
+		writing++;
+
+		lock.unlock();
+		try {
+			write(out, scratch, compressed);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> error_lock(mutex);
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+		lock.lock();
+
+		writing--;
+		written++;
+		free_buffers.push_back(std::move(out.pixels));
+		done_cond.notify_all();
+	}
+}
+
+void Frame_capture::rethrow_error()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	stats.written = written;
+	if (error) {
+		std::exception_ptr res = error;
+		error = nullptr;
+		std::rethrow_exception(res);
+	}
+}
+
+// Appends a PNG chunk to `file`
+static bool write_png_chunk(std::FILE* file, const char* type, const unsigned char* data, uint32_t size)
+{
+	const unsigned char length[4] = {
+		static_cast<unsigned char>(size >> 24), static_cast<unsigned char>(size >> 16),
+		static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size)
+	};
+	uLong crc = crc32(0, reinterpret_cast<const Bytef*>(type), 4);
+	if (size > 0) { // crc32 returns the initial value given a null buffer
+		crc = crc32(crc, data, size);
+	}
+	const unsigned char crc_bytes[4] = {
+		static_cast<unsigned char>(crc >> 24), static_cast<unsigned char>(crc >> 16),
+		static_cast<unsigned char>(crc >> 8), static_cast<unsigned char>(crc)
+	};
+	return std::fwrite(length, 4, 1, file) == 1 && std::fwrite(type, 4, 1, file) == 1
+	       && (size == 0 || std::fwrite(data, size, 1, file) == 1) && std::fwrite(crc_bytes, 4, 1, file) == 1;
+}
+
+void Frame_capture::write(const Frame& out, std::vector<unsigned char>& scratch, std::vector<unsigned char>& compressed)
+{
+	PROFILE_SCOPE("Frame_capture::write");
+	const size_t pitch = width * 4;
+
+	if (format == Format::raw) {
+		for (int row = height - 1; row >= 0; row--) {
+			if (std::fwrite(out.pixels.data() + row * pitch, pitch, 1, stream) != 1) {
+				throw std::runtime_error("Frame_capture: cannot write to "s + path);
+			}
+		}
+		return;
+	}
+
+	// PNG: RGB (the alpha of the framebuffer is not meant to be seen), top-down, "Up" filter, fast compression
+	const size_t png_pitch = 1 + width * 3;
+	scratch.resize(png_pitch * height);
+	for (int y = 0; y < height; y++) {
+		const unsigned char* src = out.pixels.data() + (height - 1 - y) * pitch;
+		const unsigned char* above = out.pixels.data() + (height - y) * pitch;
+		unsigned char* dst = scratch.data() + y * png_pitch;
+		*dst++ = y == 0 ? 0 : 2;
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 3; c++) {
+				*dst++ = y == 0 ? src[x * 4 + c] : src[x * 4 + c] - above[x * 4 + c];
+			}
+		}
+	}
+	uLongf compressed_size = compressBound(scratch.size());
+	compressed.resize(compressed_size);
+	if (compress2(compressed.data(), &compressed_size, scratch.data(), scratch.size(), Z_BEST_SPEED) != Z_OK) {
+		throw std::runtime_error("Frame_capture: cannot compress frame");
+	}
+
+	char filename[1024];
+	std::snprintf(filename, sizeof(filename), path.c_str(), out.frame);
+	std::FILE* file = std::fopen(filename, "wb");
+	if (file == nullptr) {
+		throw std::runtime_error("Frame_capture: cannot open "s + filename);
+	}
+	const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+	const unsigned char header[13] = {
+		static_cast<unsigned char>(width >> 24), static_cast<unsigned char>(width >> 16),
+		static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width),
+		static_cast<unsigned char>(height >> 24), static_cast<unsigned char>(height >> 16),
+		static_cast<unsigned char>(height >> 8), static_cast<unsigned char>(height),
+		8, 2, 0, 0, 0 // 8 bits, RGB, deflate, adaptive filtering, not interlaced
+	};
+	bool ok = std::fwrite(signature, sizeof(signature), 1, file) == 1
+	          && write_png_chunk(file, "IHDR", header, sizeof(header))
+	          && write_png_chunk(file, "IDAT", compressed.data(), compressed_size)
+	          && write_png_chunk(file, "IEND", nullptr, 0);
+	ok = std::fclose(file) == 0 && ok;
+	if (!ok) {
+		throw std::runtime_error("Frame_capture: cannot write to "s + filename);
+	}
+}
+
+} // namespace Engine::Renderer
+
+#endif // EMSCRIPTEN
@@ -0,0 +1,126 @@
+/*
+    3D Physics Simulations - Frame capture: asynchronous read back of the rendered frames
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_FRAME_CAPTURE_HPP
+#define SIMULATION_FRAME_CAPTURE_HPP
+
+#ifndef EMSCRIPTEN // WebGL2 has no fence polling on buffer reads, and no files
+
+#include <GLES3/gl3.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// Records the rendered frames without stalling the GL pipeline:
+// frames are resolved into a single sampled framebuffer, read back into a ring of pixel buffer objects,
+// then collected once their fence is signaled and encoded by writer threads
+class Frame_capture {
+public:
+	enum class Format {
+		png_sequence, // `path` is a printf pattern with one %u for the frame number, eg: "capture/frame_%05u.png"
+		raw           // `path` is a file, or a command to pipe to if prefixed by '|'; RGBA8 frames, top-down
+	};
+
+	struct Stats {
+		unsigned captured = 0; // read back requested
+		unsigned written = 0;
+		unsigned stalls = 0; // frames that waited for the GPU or for the writers
+	};
+
+	// `source`: framebuffer to capture (0 for the window), `width`×`height` from its origin
+	// `ring_size`: frames in flight on the GPU; `max_queued`: frames read back but not yet written
+	// `writer_count`: encoding threads, forced to 1 for the raw format to keep the frames ordered
+	// throws a runtime_exception if the output cannot be opened, an Engine::Error if the PNG pattern is not a frame number pattern
+	Frame_capture(Format format, const std::string& path, GLuint source, int width, int height,
+	              unsigned ring_size = 3, unsigned max_queued = 8, unsigned writer_count = 2);
+	// Collects the frames in flight and waits for the writers
+	~Frame_capture();
+	Frame_capture(const Frame_capture&) = delete;
+	Frame_capture(Frame_capture&&) = delete;
+	Frame_capture& operator=(const Frame_capture&) = delete;
+	Frame_capture& operator=(Frame_capture&&) = delete;
+
+	// Starts reading back the current content of the source framebuffer, call once per frame from the GL thread
+	// rethrows the exception of a failed write
+	void capture();
+
+	[[nodiscard]] const Stats& get_stats() const { return stats; }
+	[[nodiscard]] int get_width() const { return width; }
+	[[nodiscard]] int get_height() const { return height; }
+
+private:
+	// A read back in flight
+	struct Slot {
+		GLuint pbo = GL_NONE;
+		GLsync fence = nullptr; // null when free
+		unsigned frame = 0;
+	};
+
+	// A read back frame, to write
+	struct Frame {
+		unsigned frame;
+		std::vector<unsigned char> pixels; // bottom-up, as read by GL
+	};
+
+	void collect(Slot& slot, bool wait); // hands the frame over to the writers once read back
+	void writer_run();
+	void write(const Frame& frame, std::vector<unsigned char>& scratch, std::vector<unsigned char>& compressed);
+	void rethrow_error();
+
+	const Format format;
+	const std::string path;
+	const GLuint source;
+	const int width, height;
+	const unsigned max_queued;
+
+	GLuint framebuffer = GL_NONE; // single sampled copy of the source
+	GLuint renderbuffer = GL_NONE;
+	std::vector<Slot> ring;
+	unsigned next_slot = 0; // oldest in flight, next to be reused
+	unsigned frame = 0;
+	Stats stats;
+
+	std::FILE* stream = nullptr; // raw format
+	bool pipe = false;
+
+	std::mutex mutex;
+	std::condition_variable cond; // frames queued, or quit
+	std::condition_variable done_cond; // a frame was written
+	bool quit = false;
+	std::deque<Frame> queue;
+	std::vector<std::vector<unsigned char>> free_buffers; // recycled frame buffers
+	unsigned writing = 0;
+	unsigned written = 0;
+	std::exception_ptr error;
+	std::vector<std::thread> writers;
+};
+
+} // namespace Engine::Renderer
+
+#endif // EMSCRIPTEN
+
+#endif //SIMULATION_FRAME_CAPTURE_HPP
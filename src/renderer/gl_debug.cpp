@@ -0,0 +1,132 @@
+/*
+    3D Physics Simulations - GL debug: asynchronous GL error reporting
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "gl_debug.hpp"
+
+#include <GLES2/gl2ext.h>
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using std::literals::string_literals::operator""s;
+
+namespace Engine::Renderer {
+
+const char* gl_error_string(GLenum error)
+{
+	switch (error) {
+		case GL_NO_ERROR:                      return "no error";
+		case GL_INVALID_ENUM:                  return "invalid enum value";
+		case GL_INVALID_VALUE:                 return "invalid argument";
+		case GL_INVALID_OPERATION:             return "operation not allowed";
+		case GL_INVALID_FRAMEBUFFER_OPERATION: return "framebuffer operation not allowed";
+		case GL_OUT_OF_MEMORY:                 return "OUT OF MEMORY"; // this error is fatal to the GL state
+		default:                               return "unknown error";
+	}
+}
+
+static bool has_extension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint it = 0; it < count; it++) {
+		if (std::strcmp(reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, it)), name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Gl_debug::init([[maybe_unused]] Gl_proc_loader loader)
+{
+#if !defined(NDEBUG) && !defined(EMSCRIPTEN)
+	if (!has_extension("GL_KHR_debug")) {
+		return;
+	}
+	auto debug_message_callback = reinterpret_cast<PFNGLDEBUGMESSAGECALLBACKKHRPROC>(loader("glDebugMessageCallbackKHR"));
+	auto debug_message_control = reinterpret_cast<PFNGLDEBUGMESSAGECONTROLKHRPROC>(loader("glDebugMessageControlKHR"));
+	if (debug_message_callback == nullptr || debug_message_control == nullptr) {
+		return;
+	}
+	debug_message_callback(callback, this);
+	// Notifications are too verbose (eg: buffer placement hints)
+	debug_message_control(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION_KHR, 0, nullptr, GL_FALSE);
+	glEnable(GL_DEBUG_OUTPUT_KHR);
+	glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR); // let the driver call back from any thread, later
+	async = true;
+#endif
+}
+
+void GL_APIENTRY Gl_debug::callback([[maybe_unused]] GLenum source, GLenum type, [[maybe_unused]] GLuint id, GLenum severity,
+                                    GLsizei length, const GLchar* message, const void* user)
+{
+	auto* self = static_cast<Gl_debug*>(const_cast<void*>(user));
+	std::lock_guard<std::mutex> lock(self->mutex);
+	if (self->messages.size() < max_messages) {
+		self->messages.push_back({type, severity, length < 0 ? std::string(message) : std::string(message, length)});
+	}
+	else {
+		self->dropped++;
+	}
+}
+
+void Gl_debug::new_frame()
+{
+	frame++;
+	if (!async) {
+		if (sample_interval > 0 && frame % sample_interval == 0) {
+			GLenum error = glGetError();
+			if (error != GL_NO_ERROR) {
+				throw std::runtime_error("GL Error: "s + gl_error_string(error) + ", sampled at frame " + std::to_string(frame));
+			}
+		}
+		return;
+	}
+
+	unsigned frame_dropped;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		reported.swap(messages);
+		frame_dropped = dropped;
+		dropped = 0;
+	}
+
+	std::string first_error;
+	for (const Message& message: reported) {
+		std::cerr << "GL debug (frame " << frame << "): " << message.text << std::endl;
+		if (message.type == GL_DEBUG_TYPE_ERROR_KHR && first_error.empty()) {
+			first_error = message.text;
+		}
+	}
+	if (frame_dropped > 0) {
+		std::cerr << "GL debug (frame " << frame << "): " << frame_dropped << " messages dropped" << std::endl;
+	}
+	reported.clear();
+
+	if (!first_error.empty()) {
+		throw std::runtime_error("GL Error: " + first_error);
+	}
+}
+
+Gl_debug& Gl_debug::get()
+{
+	static Gl_debug instance;
+	return instance;
+}
+
+} // namespace Engine::Renderer
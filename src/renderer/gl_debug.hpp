@@ -0,0 +1,90 @@
+/*
+    3D Physics Simulations - GL debug: asynchronous GL error reporting
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_GL_DEBUG_HPP
+#define SIMULATION_GL_DEBUG_HPP
+
+#include <GLES3/gl3.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// Reports the GL errors without serialising the GL pipeline:
+// - debug builds with KHR_debug: the driver calls back asynchronously, messages are buffered and reported once per frame
+// - otherwise: glGetError is sampled once every `sample_interval` frames
+// check_gl_error (see utils.hpp) is compiled out of release builds, and a no-op when the callback is installed
+class Gl_debug {
+public:
+	using Gl_proc = void (*)();
+	using Gl_proc_loader = Gl_proc (*)(const char*); // eg: glfwGetProcAddress, eglGetProcAddress
+
+	// Installs the KHR_debug callback if available (only in debug builds), call once the context is current
+	void init(Gl_proc_loader loader);
+
+	// Whether the errors are reported by the KHR_debug callback
+	[[nodiscard]] bool is_async() const { return async; }
+
+	// Call once per frame: prints the buffered messages on std::cerr, or samples glGetError
+	// throws a runtime_exception if a GL error was reported
+	void new_frame();
+
+	// Frames between two glGetError without KHR_debug (0 disables the sampling)
+	void set_sample_interval(unsigned frames) { sample_interval = frames; }
+
+	// Lazy initialised singleton
+	static Gl_debug& get();
+
+private:
+	Gl_debug() = default;
+	~Gl_debug() = default;
+	Gl_debug(const Gl_debug&) = delete;
+	Gl_debug(Gl_debug&&) = delete;
+	Gl_debug& operator=(const Gl_debug&) = delete;
+	Gl_debug& operator=(Gl_debug&&) = delete;
+
+	struct Message {
+		GLenum type;
+		GLenum severity;
+		std::string text;
+	};
+
+	static void GL_APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* user);
+
+	static constexpr size_t max_messages = 256; // per frame, the others are counted as dropped
+
+	bool async = false;
+	unsigned sample_interval = 60;
+	unsigned frame = 0;
+
+	// Filled by the callback, possibly from a driver thread
+	std::mutex mutex;
+	std::vector<Message> messages;
+	unsigned dropped = 0;
+	std::vector<Message> reported; // swapped with `messages` by `new_frame`
+};
+
+// Description of a glGetError value
+const char* gl_error_string(GLenum error);
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_GL_DEBUG_HPP
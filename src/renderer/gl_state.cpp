@@ -0,0 +1,403 @@
+/*
+    3D Physics Simulations - GL state: shadows the GL bindings to skip redundant calls
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "gl_state.hpp"
+
+#include <imgui/imgui.h>
+
+#include <numeric>
+#include <sstream>
+
+namespace Engine::Renderer {
+
+unsigned Gl_state::Stats::total_issued() const
+{
+	return std::accumulate(issued.begin(), issued.end(), 0u);
+}
+
+unsigned Gl_state::Stats::total_skipped() const
+{
+	return std::accumulate(skipped.begin(), skipped.end(), 0u);
+}
+
+Gl_state& Gl_state::get()
+{
+	static Gl_state instance;
+	return instance;
+}
+
+bool Gl_state::update(Call_type type, GLuint& shadow, GLuint value)
+{
+	if (shadow == value) {
+		stats.skipped[type]++;
+		return false;
+	}
+	shadow = value;
+	stats.issued[type]++;
+	return true;
+}
+
+void Gl_state::use_program(GLuint program)
+{
+	if (update(Call_type::program, current_program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void Gl_state::bind_vertex_array(GLuint vao)
+{
+	if (update(Call_type::vertex_array, current_vao, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+GLuint* Gl_state::buffer_slot(GLenum target)
+{
+	for (auto& it: buffers) {
+		if (it.first == target) {
+			return &it.second;
+		}
+	}
+	return nullptr;
+}
+
+void Gl_state::bind_buffer(GLenum target, GLuint buffer)
+{
+	GLuint* slot = buffer_slot(target);
+	if (slot == nullptr) {
+		stats.issued[Call_type::buffer]++;
+		glBindBuffer(target, buffer);
+	}
+	else if (update(Call_type::buffer, *slot, buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void Gl_state::bind_buffer_base(GLenum target, GLuint index, GLuint buffer)
+{
+	stats.issued[Call_type::buffer]++;
+	glBindBufferBase(target, index, buffer);
+	if (GLuint* slot = buffer_slot(target)) {
+		*slot = buffer;
+	}
+}
+
+void Gl_state::bind_texture(GLuint texture, GLuint unit)
+{
+	if (active_unit != unit) {
+		active_unit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	if (update(Call_type::texture, textures.at(unit), texture)) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+}
+
+void Gl_state::deleted_program(GLuint program)
+{
+	if (current_program == program) current_program = unknown;
+}
+
+void Gl_state::deleted_vertex_array(GLuint vao)
+{
+	if (current_vao == vao) current_vao = GL_NONE; // reverts to the default VAO
+}
+
+void Gl_state::deleted_buffer(GLuint buffer)
+{
+	for (auto& it: buffers) {
+		if (it.second == buffer) it.second = GL_NONE;
+	}
+	if (auto it = buffer_sizes.find(buffer); it != buffer_sizes.end()) {
+		resources.buffers--;
+		resources.buffer_bytes -= it->second;
+		buffer_sizes.erase(it);
+	}
+}
+
+void Gl_state::deleted_texture(GLuint texture)
+{
+	for (GLuint& it: textures) {
+		if (it == texture) it = GL_NONE;
+	}
+	if (auto it = texture_sizes.find(texture); it != texture_sizes.end()) {
+		resources.textures--;
+		resources.texture_bytes -= it->second.total;
+		texture_sizes.erase(it);
+	}
+}
+
+GLuint Gl_state::bound_buffer(GLenum target)
+{
+	GLuint* slot = buffer_slot(target);
+	if (slot != nullptr && *slot != unknown) {
+		return *slot;
+	}
+	GLenum binding;
+	switch (target) {
+		case GL_ARRAY_BUFFER:         binding = GL_ARRAY_BUFFER_BINDING;         break;
+		case GL_ELEMENT_ARRAY_BUFFER: binding = GL_ELEMENT_ARRAY_BUFFER_BINDING; break;
+		case GL_COPY_READ_BUFFER:     binding = GL_COPY_READ_BUFFER_BINDING;     break;
+		case GL_COPY_WRITE_BUFFER:    binding = GL_COPY_WRITE_BUFFER_BINDING;    break;
+		case GL_PIXEL_PACK_BUFFER:    binding = GL_PIXEL_PACK_BUFFER_BINDING;    break;
+		case GL_PIXEL_UNPACK_BUFFER:  binding = GL_PIXEL_UNPACK_BUFFER_BINDING;  break;
+		case GL_UNIFORM_BUFFER:       binding = GL_UNIFORM_BUFFER_BINDING;       break;
+		default:                      binding = GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+	}
+	GLint buffer = 0;
+	glGetIntegerv(binding, &buffer);
+	if (slot != nullptr) {
+		*slot = buffer;
+	}
+	return buffer;
+}
+
+GLuint Gl_state::bound_texture()
+{
+	if (active_unit != unknown && textures.at(active_unit) != unknown) {
+		return textures[active_unit];
+	}
+	GLint texture = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
+	return texture;
+}
+
+// Bytes per pixel of client pixel data
+static uint64_t pixel_size(GLenum format, GLenum type)
+{
+	switch (type) {
+		case GL_UNSIGNED_SHORT_5_6_5:
+		case GL_UNSIGNED_SHORT_4_4_4_4:
+		case GL_UNSIGNED_SHORT_5_5_5_1:        return 2;
+		case GL_UNSIGNED_INT_2_10_10_10_REV:
+		case GL_UNSIGNED_INT_10F_11F_11F_REV:
+		case GL_UNSIGNED_INT_5_9_9_9_REV:
+		case GL_UNSIGNED_INT_24_8:             return 4;
+		default: break;
+	}
+	uint64_t components;
+	switch (format) {
+		case GL_RED: case GL_RED_INTEGER: case GL_ALPHA: case GL_LUMINANCE: case GL_DEPTH_COMPONENT: components = 1; break;
+		case GL_RG: case GL_RG_INTEGER: case GL_LUMINANCE_ALPHA:                                      components = 2; break;
+		case GL_RGB: case GL_RGB_INTEGER:                                                             components = 3; break;
+		default:                                                                                      components = 4;
+	}
+	switch (type) {
+		case GL_UNSIGNED_BYTE: case GL_BYTE:                       return components;
+		case GL_UNSIGNED_SHORT: case GL_SHORT: case GL_HALF_FLOAT: return components * 2;
+		default:                                                   return components * 4;
+	}
+}
+
+void Gl_state::draw_arrays(GLenum mode, GLint first, GLsizei count)
+{
+	stats.draws++;
+	stats.vertices += count;
+	glDrawArrays(mode, first, count);
+}
+
+void Gl_state::draw_arrays_instanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+{
+	stats.draws++;
+	stats.instanced_draws++;
+	stats.vertices += static_cast<uint64_t>(count) * instances;
+	glDrawArraysInstanced(mode, first, count, instances);
+}
+
+void Gl_state::draw_elements(GLenum mode, GLsizei count, GLenum type, const void* offset)
+{
+	stats.draws++;
+	stats.vertices += count;
+	glDrawElements(mode, count, type, offset);
+}
+
+void Gl_state::draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, const void* offset, GLsizei instances)
+{
+	stats.draws++;
+	stats.instanced_draws++;
+	stats.vertices += static_cast<uint64_t>(count) * instances;
+	glDrawElementsInstanced(mode, count, type, offset, instances);
+}
+
+void Gl_state::buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+{
+	glBufferData(target, size, data, usage);
+	if (data != nullptr) {
+		stats.buffer_uploads++;
+		stats.buffer_upload_bytes += size;
+	}
+	auto [it, created] = buffer_sizes.try_emplace(bound_buffer(target), 0);
+	if (created) {
+		resources.buffers++;
+	}
+	resources.buffer_bytes += size - it->second;
+	it->second = size;
+}
+
+void Gl_state::buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+	stats.buffer_uploads++;
+	stats.buffer_upload_bytes += size;
+	glBufferSubData(target, offset, size, data);
+}
+
+void* Gl_state::map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	if (access & GL_MAP_WRITE_BIT) {
+		stats.buffer_uploads++;
+		stats.buffer_upload_bytes += length;
+	}
+	return glMapBufferRange(target, offset, length, access);
+}
+
+// Sets the size of a level, the levels are (re)specified in order from the base level
+static void set_level_size(uint64_t& total_bytes, uint64_t& base, uint64_t& total, GLint level, uint64_t bytes)
+{
+	total_bytes -= total;
+	if (level == 0) {
+		base = total = bytes;
+	}
+	else {
+		total += bytes;
+	}
+	total_bytes += total;
+}
+
+void Gl_state::tex_image_2d(GLint level, GLint internal_format, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+	glTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, format, type, pixels);
+	const uint64_t bytes = static_cast<uint64_t>(width) * height * pixel_size(format, type);
+	GLuint* unpack = buffer_slot(GL_PIXEL_UNPACK_BUFFER);
+	if (pixels != nullptr || (*unpack != GL_NONE && *unpack != unknown)) {
+		stats.texture_uploads++;
+		stats.texture_upload_bytes += bytes;
+	}
+	auto [it, created] = texture_sizes.try_emplace(bound_texture());
+	if (created) {
+		resources.textures++;
+	}
+	set_level_size(resources.texture_bytes, it->second.base, it->second.total, level, bytes);
+}
+
+void Gl_state::compressed_tex_image_2d(GLint level, GLenum internal_format, GLsizei width, GLsizei height, GLsizei image_size, const void* data)
+{
+	glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, width, height, 0, image_size, data);
+	stats.texture_uploads++;
+	stats.texture_upload_bytes += image_size;
+	auto [it, created] = texture_sizes.try_emplace(bound_texture());
+	if (created) {
+		resources.textures++;
+	}
+	set_level_size(resources.texture_bytes, it->second.base, it->second.total, level, image_size);
+}
+
+void Gl_state::tex_sub_image_2d(GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels)
+{
+	stats.texture_uploads++;
+	stats.texture_upload_bytes += static_cast<uint64_t>(width) * height * pixel_size(format, type);
+	glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, format, type, pixels);
+}
+
+void Gl_state::generate_mipmap()
+{
+	glGenerateMipmap(GL_TEXTURE_2D);
+	if (auto it = texture_sizes.find(bound_texture()); it != texture_sizes.end()) {
+		// The chain of a power of 2 texture: a third of the base level
+		resources.texture_bytes -= it->second.total;
+		it->second.total = it->second.base * 4 / 3;
+		resources.texture_bytes += it->second.total;
+	}
+}
+
+void Gl_state::read_pixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
+{
+	stats.readbacks++;
+	stats.readback_bytes += static_cast<uint64_t>(width) * height * pixel_size(format, type);
+	glReadPixels(x, y, width, height, format, type, pixels);
+}
+
+void Gl_state::invalidate()
+{
+	current_program = unknown;
+	current_vao = unknown;
+	active_unit = unknown;
+	textures.fill(unknown);
+	buffers = {{
+		{GL_ARRAY_BUFFER, unknown},
+		{GL_COPY_READ_BUFFER, unknown},
+		{GL_COPY_WRITE_BUFFER, unknown},
+		{GL_PIXEL_PACK_BUFFER, unknown},
+		{GL_PIXEL_UNPACK_BUFFER, unknown},
+		{GL_UNIFORM_BUFFER, unknown},
+	}};
+}
+
+void Gl_state::new_frame()
+{
+	invalidate();
+	last_stats = stats;
+	stats = {};
+}
+
+void Gl_state::draw_window()
+{
+	ImGuiIO& io = ImGui::GetIO();
+	ImGui::SetNextWindowPos(ImVec2{io.DisplaySize.x, io.DisplaySize.y / 3.f}, ImGuiCond_FirstUseEver, ImVec2{1.f, 0.f});
+	ImGui::SetNextWindowCollapsed(true, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("GL stats", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+		ImGui::End();
+		return;
+	}
+
+	const Stats& frame = last_stats;
+	constexpr float kib = 1024.f;
+	ImGui::Text("draws: %u (%u instanced), %llu vertices", frame.draws, frame.instanced_draws, static_cast<unsigned long long>(frame.vertices));
+	ImGui::Text("buffer uploads: %u, %.1f KiB", frame.buffer_uploads, frame.buffer_upload_bytes / kib);
+	ImGui::Text("texture uploads: %u, %.1f KiB", frame.texture_uploads, frame.texture_upload_bytes / kib);
+	ImGui::Text("read backs: %u, %.1f KiB", frame.readbacks, frame.readback_bytes / kib);
+	ImGui::Text("state calls: %u issued, %u skipped", frame.total_issued(), frame.total_skipped());
+	for (unsigned type = 0; type < call_type_count; type++) {
+		ImGui::BulletText("%s: %u issued, %u skipped", call_type_names[type], frame.issued[type], frame.skipped[type]);
+	}
+	ImGui::Separator();
+	ImGui::Text("buffers: %u, %.1f KiB", resources.buffers, resources.buffer_bytes / kib);
+	ImGui::Text("textures: %u, %.1f KiB", resources.textures, resources.texture_bytes / kib);
+	if (ImGui::Button("Copy as JSON")) {
+		std::ostringstream out;
+		write_json(out);
+		ImGui::SetClipboardText(out.str().c_str());
+	}
+
+	ImGui::End();
+}
+
+void Gl_state::write_json(std::ostream& out) const
+{
+	const Stats& frame = last_stats;
+	out << "{\"draws\":" << frame.draws << ",\"instanced_draws\":" << frame.instanced_draws << ",\"vertices\":" << frame.vertices
+	    << ",\"buffer_uploads\":" << frame.buffer_uploads << ",\"buffer_upload_bytes\":" << frame.buffer_upload_bytes
+	    << ",\"texture_uploads\":" << frame.texture_uploads << ",\"texture_upload_bytes\":" << frame.texture_upload_bytes
+	    << ",\"readbacks\":" << frame.readbacks << ",\"readback_bytes\":" << frame.readback_bytes << ",\"state_calls\":{";
+	for (unsigned type = 0; type < call_type_count; type++) {
+		out << (type == 0 ? "" : ",") << '"' << call_type_names[type] << "\":{\"issued\":" << frame.issued[type]
+		    << ",\"skipped\":" << frame.skipped[type] << '}';
+	}
+	out << "},\"buffers\":" << resources.buffers << ",\"buffer_bytes\":" << resources.buffer_bytes
+	    << ",\"textures\":" << resources.textures << ",\"texture_bytes\":" << resources.texture_bytes << "}\n";
+}
+
+} // namespace Engine::Renderer
@@ -0,0 +1,180 @@
+/*
+    3D Physics Simulations - GL state: shadows the GL bindings to skip redundant calls
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_GL_STATE_HPP
+#define SIMULATION_GL_STATE_HPP
+
+#include <GLES3/gl3.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <unordered_map>
+
+namespace Engine::Renderer {
+
+// Shadows the current program, VAO, buffer and texture bindings, and skips the calls that would not change them
+// Every bind of the renderer must go through this class, or the shadow copy gets out of sync
+// Uniform values are shadowed by their owner (see `update_uniform` and Renderer)
+// Also accounts the draw calls, the uploads and the memory of the buffers and textures of the renderer,
+// that go through its wrappers (DearImGui does not)
+class Gl_state {
+public:
+	enum Call_type { program, vertex_array, buffer, texture, uniform, call_type_count };
+
+	struct Stats {
+		std::array<unsigned, call_type_count> issued{};
+		std::array<unsigned, call_type_count> skipped{};
+
+		unsigned draws = 0; // including the instanced draws
+		unsigned instanced_draws = 0;
+		uint64_t vertices = 0; // vertices (or indices) drawn, times the instances
+		unsigned buffer_uploads = 0; // glBufferData, glBufferSubData and mapped ranges for writing
+		uint64_t buffer_upload_bytes = 0;
+		unsigned texture_uploads = 0;
+		uint64_t texture_upload_bytes = 0;
+		unsigned readbacks = 0; // glReadPixels
+		uint64_t readback_bytes = 0;
+
+		[[nodiscard]] unsigned total_issued() const;
+		[[nodiscard]] unsigned total_skipped() const;
+	};
+
+	// Live objects allocated through the wrappers below
+	struct Resources {
+		unsigned buffers = 0;
+		uint64_t buffer_bytes = 0;
+		unsigned textures = 0;
+		uint64_t texture_bytes = 0; // estimated from the formats, mip levels included
+	};
+
+	static constexpr const char* call_type_names[call_type_count] = { "program", "vertex array", "buffer", "texture", "uniform" };
+
+	// Unique static instance (there is only one GL context)
+	static Gl_state& get();
+
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vao);
+	// The element array buffer binding is part of the VAO state, it is never skipped
+	void bind_buffer(GLenum target, GLuint buffer);
+	// Indexed binding, also binds the generic binding point (never skipped)
+	void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+	// Binds a GL_TEXTURE_2D on the given texture unit (sets the active texture unit)
+	void bind_texture(GLuint texture, GLuint unit = 0);
+
+	// Deleted objects are unbound by GL, call these after glDelete*
+	void deleted_program(GLuint program);
+	void deleted_vertex_array(GLuint vao);
+	void deleted_buffer(GLuint buffer);
+	void deleted_texture(GLuint texture);
+
+	// Counted draw calls
+	void draw_arrays(GLenum mode, GLint first, GLsizei count);
+	void draw_arrays_instanced(GLenum mode, GLint first, GLsizei count, GLsizei instances);
+	void draw_elements(GLenum mode, GLsizei count, GLenum type, const void* offset);
+	void draw_elements_instanced(GLenum mode, GLsizei count, GLenum type, const void* offset, GLsizei instances);
+
+	// Counted uploads to the buffer bound to `target`, whose size is tracked
+	void buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+	void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+	void* map_buffer_range(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access);
+
+	// Counted uploads to the GL_TEXTURE_2D bound to the active unit, whose size is tracked
+	void tex_image_2d(GLint level, GLint internal_format, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+	void compressed_tex_image_2d(GLint level, GLenum internal_format, GLsizei width, GLsizei height, GLsizei image_size, const void* data);
+	void tex_sub_image_2d(GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels);
+	void generate_mipmap();
+
+	// Counted read back from the read framebuffer
+	void read_pixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels);
+
+	// Updates the shadow copy of a uniform value, returns true if the glUniform* call must be issued
+	template<typename T>
+	bool update_uniform(std::optional<T>& shadow, const T& value)
+	{
+		if (shadow && *shadow == value) {
+			stats.skipped[uniform]++;
+			return false;
+		}
+		shadow = value;
+		stats.issued[uniform]++;
+		return true;
+	}
+
+	// Forget the shadowed bindings, to call when foreign code (e.g. DearImGui) modified the GL state
+	void invalidate();
+
+	// Invalidates and starts a new stats frame, to call at the beginning of each frame
+	void new_frame();
+
+	// Counters of the last frame
+	[[nodiscard]] const Stats& get_stats() const { return last_stats; }
+	[[nodiscard]] const Resources& get_resources() const { return resources; }
+
+	// Counters of the last frame and live resources, call between ImGui::NewFrame and ImGui::Render
+	void draw_window();
+
+	// Counters of the last frame and live resources as a single line JSON object
+	void write_json(std::ostream& out) const;
+
+private:
+	Gl_state() { invalidate(); }
+	~Gl_state() = default;
+	Gl_state(const Gl_state&) = delete;
+	Gl_state(Gl_state&&) = delete;
+	Gl_state& operator=(const Gl_state&) = delete;
+	Gl_state& operator=(Gl_state&&) = delete;
+
+	static constexpr GLuint unknown = ~0u;
+	static constexpr GLuint texture_unit_count = 16; // minimum required by GL ES3
+
+	// Returns the slot of a shadowed buffer target, nullptr if not shadowed
+	GLuint* buffer_slot(GLenum target);
+
+	// Counts the call and returns true if it must be issued
+	bool update(Call_type type, GLuint& shadow, GLuint value);
+
+	// Name of the buffer bound to `target`, queried if not shadowed
+	GLuint bound_buffer(GLenum target);
+	// Name of the texture bound to the active unit, queried if not shadowed
+	GLuint bound_texture();
+
+	struct Texture_size {
+		uint64_t base = 0; // level 0
+		uint64_t total = 0;
+	};
+
+	GLuint current_program = unknown;
+	GLuint current_vao = unknown;
+	GLuint active_unit = unknown;
+	std::array<GLuint, texture_unit_count> textures;
+	std::array<std::pair<GLenum, GLuint>, 6> buffers;
+
+	Stats stats;
+	Stats last_stats;
+
+	Resources resources;
+	std::unordered_map<GLuint, uint64_t> buffer_sizes;
+	std::unordered_map<GLuint, Texture_size> texture_sizes;
+};
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_GL_STATE_HPP
@@ -0,0 +1,52 @@
+/*
+    3D Physics Simulations - KTX: Khronos texture container layout, shared with the texconv tool
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_KTX_HPP
+#define SIMULATION_KTX_HPP
+
+#include <cstdint>
+
+namespace Engine::Renderer::Ktx {
+
+// KTX 1.1 file header, followed by the key/value data and, for each mip level, its size (uint32) and its data
+// see https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html
+struct Header {
+	uint8_t identifier[12];
+	uint32_t endianness;
+	uint32_t gl_type; // 0 if compressed
+	uint32_t gl_type_size;
+	uint32_t gl_format; // 0 if compressed
+	uint32_t gl_internal_format;
+	uint32_t gl_base_internal_format;
+	uint32_t pixel_width;
+	uint32_t pixel_height;
+	uint32_t pixel_depth;
+	uint32_t array_elements;
+	uint32_t faces;
+	uint32_t mipmap_levels;
+	uint32_t key_value_bytes;
+};
+static_assert(sizeof(Header) == 64, "KTX header must be packed");
+
+constexpr uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+constexpr uint32_t endianness = 0x04030201; // written in the native byte order
+
+} // namespace Engine::Renderer::Ktx
+
+#endif //SIMULATION_KTX_HPP
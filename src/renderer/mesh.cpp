@@ -19,37 +19,134 @@
 #include "utils.hpp"
 #include "renderer.hpp"
 
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
 #include <iostream>
+#include <cstddef>
+#include <cstring>
 
 namespace Engine::Renderer {
 
+Instance_buffer::Instance_buffer():
+		buf(generateArray<glGenBuffers>())
+{}
+
+Instance_buffer::~Instance_buffer()
+{
+	glDeleteBuffers(1, &buf);
+	Gl_state::get().deleted_buffer(buf);
+}
+
+void Instance_buffer::update(const vector<Instance>& instances)
+{
+	Gl_state::get().bind_buffer(GL_ARRAY_BUFFER, buf);
+	Gl_state::get().buffer_data(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+	count = instances.size();
+}
+
+GLsizei Vertex_layout::colour_size() const
+{
+	switch (colour) {
+		case Colour_format::float3:   return 3 * sizeof(GLfloat);
+		case Colour_format::unorm8x4: return 4 * sizeof(GLubyte);
+		default:                      return 0;
+	}
+}
+
+GLsizei Vertex_layout::uv_size() const
+{
+	switch (uv) {
+		case Uv_format::float2: return 2 * sizeof(GLfloat);
+		case Uv_format::half2:  return 2 * sizeof(GLushort);
+		default:                return 0;
+	}
+}
+
 Static_indexed_mesh::Static_indexed_mesh(const vector<GLuint>& indices, const vector<GLfloat>& vertices, const vector<GLfloat>& colours, const vector<GLfloat>& uvs):
+		Static_indexed_mesh(indices, vertices, colours, uvs, Vertex_layout::compact())
+{}
+
+Static_indexed_mesh::Static_indexed_mesh(const vector<GLuint>& indices, const vector<GLfloat>& vertices, const vector<GLfloat>& colours, const vector<GLfloat>& uvs, Vertex_layout layout):
 		indices_size(indices.size()),
+		// 16 bits indices if all the vertices can be addressed
+		index_type(vertices.size() / vertex_component_number <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT),
 		indices_buf(generateArray<glGenBuffers>()),
 		vertices_buf(generateArray<glGenBuffers>()),
-		colours_buf(generateArray<glGenBuffers>(!colours.empty())),
-		uvs_buf(generateArray<glGenBuffers>(!uvs.empty())),
 		vao(generateArray<glGenVertexArrays>())
 {
-	glBindVertexArray(vao);
+	if (colours.empty()) layout.colour = Vertex_layout::Colour_format::none;
+	if (uvs.empty()) layout.uv = Vertex_layout::Uv_format::none;
 
-	transfer_geometry<GL_ARRAY_BUFFER, GL_STATIC_DRAW>(Renderer::vertex_pos_attr_loc, vertices_buf, vertices);
+	// Interleave the attributes: position, colour, uv
+	const size_t vx_count = vertices.size() / vertex_component_number;
+	const GLsizei stride = layout.stride();
+	vector<unsigned char> data(vx_count * stride);
+	for (size_t it = 0; it < vx_count; it++) {
+		unsigned char* vx = data.data() + it * stride;
+		std::memcpy(vx, &vertices[it * vertex_component_number], Vertex_layout::position_size);
 
-	if (colours_buf) {
-        transfer_geometry<GL_ARRAY_BUFFER, GL_STATIC_DRAW>(Renderer::vertex_col_attr_loc, colours_buf, colours);
-    }
+		const GLfloat* col = colours.empty() ? nullptr : &colours[it * colour_component_number];
+		switch (layout.colour) {
+			case Vertex_layout::Colour_format::float3:
+				std::memcpy(vx + layout.colour_offset(), col, layout.colour_size());
+				break;
+			case Vertex_layout::Colour_format::unorm8x4: {
+				glm::u8vec4 packed(glm::clamp(glm::vec3(col[0], col[1], col[2]), 0.f, 1.f) * 255.f + .5f, 255);
+				std::memcpy(vx + layout.colour_offset(), &packed, sizeof(packed));
+				break;
+			}
+			default: break;
+		}
 
-	if (uvs_buf) {
-        transfer_geometry<GL_ARRAY_BUFFER, GL_STATIC_DRAW, 2>(Renderer::vertex_uv_attr_loc, uvs_buf, uvs);
+		const GLfloat* uv = uvs.empty() ? nullptr : &uvs[it * uv_component_number];
+		switch (layout.uv) {
+			case Vertex_layout::Uv_format::float2:
+				std::memcpy(vx + layout.uv_offset(), uv, layout.uv_size());
+				break;
+			case Vertex_layout::Uv_format::half2: {
+				GLushort packed[2] = { glm::packHalf1x16(uv[0]), glm::packHalf1x16(uv[1]) };
+				std::memcpy(vx + layout.uv_offset(), packed, sizeof(packed));
+				break;
+			}
+			default: break;
+		}
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, GL_NONE);
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_vertex_array(vao);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
-	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_NONE); // DO NOT UNBIND !!
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, vertices_buf);
+	gl_state.buffer_data(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+
+	glEnableVertexAttribArray(Renderer::vertex_pos_attr_loc);
+	glVertexAttribPointer(Renderer::vertex_pos_attr_loc, vertex_component_number, GL_FLOAT, GL_FALSE, stride, nullptr);
+
+	if (layout.colour == Vertex_layout::Colour_format::float3) {
+		glEnableVertexAttribArray(Renderer::vertex_col_attr_loc);
+		glVertexAttribPointer(Renderer::vertex_col_attr_loc, colour_component_number, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(layout.colour_offset()));
+	}
+	else if (layout.colour == Vertex_layout::Colour_format::unorm8x4) {
+		glEnableVertexAttribArray(Renderer::vertex_col_attr_loc);
+		glVertexAttribPointer(Renderer::vertex_col_attr_loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, reinterpret_cast<const void*>(layout.colour_offset()));
+	}
 
-	glBindVertexArray(GL_NONE);
+	if (layout.uv != Vertex_layout::Uv_format::none) {
+		GLenum uv_type = (layout.uv == Vertex_layout::Uv_format::half2) ? GL_HALF_FLOAT : GL_FLOAT;
+		glEnableVertexAttribArray(Renderer::vertex_uv_attr_loc);
+		glVertexAttribPointer(Renderer::vertex_uv_attr_loc, uv_component_number, uv_type, GL_FALSE, stride, reinterpret_cast<const void*>(layout.uv_offset()));
+	}
+
+	gl_state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, indices_buf);
+	if (index_type == GL_UNSIGNED_SHORT) {
+		vector<GLushort> short_indices(indices.begin(), indices.end());
+		gl_state.buffer_data(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(GLushort), short_indices.data(), GL_STATIC_DRAW);
+	}
+	else {
+		gl_state.buffer_data(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	}
+	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GL_NONE); // DO NOT UNBIND !!
 
 	check_gl_error("Mesh::ctor");
 }
@@ -57,23 +154,50 @@ Static_indexed_mesh::Static_indexed_mesh(const vector<GLuint>& indices, const ve
 Static_indexed_mesh::~Static_indexed_mesh() {
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &indices_buf);
-	glDeleteBuffers(1, &colours_buf);
 	glDeleteBuffers(1, &vertices_buf);
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.deleted_vertex_array(vao);
+	gl_state.deleted_buffer(indices_buf);
+	gl_state.deleted_buffer(vertices_buf);
 	check_gl_error("Mesh::dtor");
 }
 
 void Static_indexed_mesh::draw(GLenum prim_type) const
 {
-	glBindVertexArray(vao);
+	// Not unbound after the draw: every user of vertex attributes binds its VAO through Gl_state
+	Gl_state::get().bind_vertex_array(vao);
 
 	//glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices_buf); // Already bound in constructor
-	glDrawElements(prim_type, indices_size, GL_UNSIGNED_INT, nullptr);
+	Gl_state::get().draw_elements(prim_type, indices_size, index_type, nullptr);
+}
+
+void Static_indexed_mesh::draw_instanced(const Instance_buffer& instances, GLenum prim_type) const
+{
+	if (instances.size() == 0) {
+		return;
+	}
 
-	glBindVertexArray(GL_NONE);
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_vertex_array(vao);
 
-#ifndef NDEBUG
-	check_gl_error("Mesh::draw");
-#endif
+	// Attach the instance buffer to this VAO, a mat4 attribute is 4 vec4 columns
+	gl_state.bind_buffer(GL_ARRAY_BUFFER, instances.get_buffer_name());
+	for (GLuint col = 0; col < 4; col++) {
+		GLuint loc = Renderer::instance_model_attr_loc + col;
+		glEnableVertexAttribArray(loc);
+		glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<const void*>(offsetof(Instance, model_m4) + col * sizeof(glm::vec4)));
+		glVertexAttribDivisor(loc, 1);
+	}
+	glEnableVertexAttribArray(Renderer::instance_tint_attr_loc);
+	glVertexAttribPointer(Renderer::instance_tint_attr_loc, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), reinterpret_cast<const void*>(offsetof(Instance, tint)));
+	glVertexAttribDivisor(Renderer::instance_tint_attr_loc, 1);
+
+	gl_state.draw_elements_instanced(prim_type, indices_size, index_type, nullptr, instances.size());
+
+	// The standard variant does not read these attributes, and the instance buffer may be deleted
+	for (GLuint loc = Renderer::instance_model_attr_loc; loc <= Renderer::instance_tint_attr_loc; loc++) {
+		glDisableVertexAttribArray(loc);
+	}
 }
 
 Triangle::Triangle():
@@ -21,6 +21,8 @@
 #define SIMULATION_MESH_HPP
 
 #include <GLES3/gl3.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
 
 #include <vector>
 
@@ -28,11 +30,63 @@ using std::vector;
 
 namespace Engine::Renderer {
 
+// Per instance attributes, read by the instanced variant of the Renderer
+struct Instance {
+	glm::mat4 model_m4;
+	glm::vec4 tint;
+};
+
+// A buffer of instances, to draw a mesh many times in a single draw call (see Static_indexed_mesh::draw_instanced)
+class Instance_buffer {
+public:
+	Instance_buffer();
+	~Instance_buffer();
+	Instance_buffer(const Instance_buffer&) = delete;
+	Instance_buffer(Instance_buffer&&) = delete;
+	Instance_buffer& operator=(const Instance_buffer&) = delete;
+	Instance_buffer& operator=(Instance_buffer&&) = delete;
+
+	// Uploads the instances, replaces the previous content
+	void update(const vector<Instance>& instances);
+
+	[[nodiscard]] GLuint get_buffer_name() const { return buf; }
+	[[nodiscard]] GLsizei size() const { return count; }
+
+private:
+	const GLuint buf;
+	GLsizei count = 0;
+};
+
+// Storage of the vertex attributes of a Static_indexed_mesh, interleaved in a single buffer
+// Positions are always 3 floats
+struct Vertex_layout {
+	enum class Colour_format { none, float3, unorm8x4 };
+	enum class Uv_format { none, float2, half2 };
+
+	Colour_format colour = Colour_format::float3;
+	Uv_format uv = Uv_format::float2;
+
+	// Full precision, as supplied
+	static constexpr Vertex_layout full() { return {Colour_format::float3, Uv_format::float2}; }
+	// Normalised unsigned byte colours and half float UVs (20 bytes per vertex instead of 32)
+	static constexpr Vertex_layout compact() { return {Colour_format::unorm8x4, Uv_format::half2}; }
+
+	static constexpr GLsizei position_size = 3 * sizeof(GLfloat);
+	[[nodiscard]] GLsizei colour_size() const;
+	[[nodiscard]] GLsizei uv_size() const;
+	[[nodiscard]] GLsizei colour_offset() const { return position_size; }
+	[[nodiscard]] GLsizei uv_offset() const { return position_size + colour_size(); }
+	[[nodiscard]] GLsizei stride() const { return position_size + colour_size() + uv_size(); }
+};
+
 // Immutable class
 class Static_indexed_mesh {
 public:
-	// Creates a VAO and Buffers and loads the data
+	// Creates a VAO and Buffers and loads the data using the compact vertex layout
 	Static_indexed_mesh(const vector<GLuint>& indices, const vector<GLfloat>& vertices, const vector<GLfloat>& colors, const vector<GLfloat>& uvs);
+	// Creates a VAO and Buffers and loads the data using the given vertex layout (empty attributes are not stored)
+	// Indices are stored on 16 bits if the number of vertices allows it
+	Static_indexed_mesh(const vector<GLuint>& indices, const vector<GLfloat>& vertices, const vector<GLfloat>& colors, const vector<GLfloat>& uvs, Vertex_layout layout);
 
 	// Delete the VAO and Buffers
 	~Static_indexed_mesh();
@@ -49,6 +103,9 @@ public:
 	// Draw mesh,
 	void draw(GLenum type = GL_TRIANGLES) const;
 
+	// Draw all the instances of the buffer in a single call, the instanced variant of the Renderer must be in use
+	void draw_instanced(const Instance_buffer& instances, GLenum type = GL_TRIANGLES) const;
+
 	constexpr static GLuint vertex_component_number = 3;
 	constexpr static GLuint colour_component_number = 3;
 	constexpr static GLuint uv_component_number = 2;
@@ -56,11 +113,11 @@ public:
 private:
 	// number of element in the indices buffer
 	const GLuint indices_size;
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	const GLenum index_type;
 	// VBO names
 	const GLuint indices_buf;
-	const GLuint vertices_buf;
-	const GLuint colours_buf;
-	const GLuint uvs_buf;
+	const GLuint vertices_buf; // interleaved attributes
 	// VAO name
 	const GLuint vao;
 };
@@ -0,0 +1,94 @@
+/*
+    3D Physics Simulations - Polygon: triangulation of simple polygons
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "polygon.hpp"
+
+#include <glm/vec2.hpp>
+
+namespace Engine::Renderer {
+
+// Twice the signed area of the triangle abc, positive if counter clockwise
+static inline float cross(glm::vec2 a, glm::vec2 b, glm::vec2 c)
+{
+	return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+// p inside or on the edges of the counter clockwise triangle abc
+static inline bool in_triangle(glm::vec2 p, glm::vec2 a, glm::vec2 b, glm::vec2 c)
+{
+	return cross(a, b, p) >= 0.f && cross(b, c, p) >= 0.f && cross(c, a, p) >= 0.f;
+}
+
+std::vector<GLuint> triangulate_polygon(const GLfloat* xy, size_t vx_count)
+{
+	std::vector<GLuint> triangles;
+	if (vx_count < 3) {
+		return triangles;
+	}
+	auto point = [xy](GLuint index) { return glm::vec2(xy[index * 2], xy[index * 2 + 1]); };
+
+	// Remaining vertices, counter clockwise
+	float area = 0.f;
+	for (size_t it = 0; it < vx_count; it++) {
+		const glm::vec2 a = point(it), b = point((it + 1) % vx_count);
+		area += a.x * b.y - b.x * a.y;
+	}
+	std::vector<GLuint> remaining(vx_count);
+	for (size_t it = 0; it < vx_count; it++) {
+		remaining[it] = static_cast<GLuint>(area >= 0.f ? it : vx_count - 1 - it);
+	}
+	triangles.reserve((vx_count - 2) * 3);
+
+	// Clip an ear (a convex vertex whose triangle contains no other vertex) until a triangle is left
+	// `attempts` counts the vertices visited since the last clip, to detect a polygon without ear (self intersecting)
+	size_t it = 0;
+	size_t attempts = 0;
+	while (remaining.size() > 3 && attempts < remaining.size()) {
+		const size_t count = remaining.size();
+		const GLuint prev = remaining[(it + count - 1) % count], cur = remaining[it], next = remaining[(it + 1) % count];
+		const glm::vec2 a = point(prev), b = point(cur), c = point(next);
+		const float corner = cross(a, b, c);
+
+		bool is_ear = corner <= 0.f ? corner == 0.f : true; // a collinear vertex is removed without a triangle
+		for (size_t other = 0; is_ear && corner > 0.f && other < count; other++) {
+			const GLuint index = remaining[other];
+			const glm::vec2 p = point(index);
+			if (index != prev && index != cur && index != next && p != a && p != b && p != c && in_triangle(p, a, b, c)) {
+				is_ear = false;
+			}
+		}
+
+		if (!is_ear) {
+			it = (it + 1) % count;
+			attempts++;
+			continue;
+		}
+		if (corner > 0.f) {
+			triangles.insert(triangles.end(), {prev, cur, next});
+		}
+		remaining.erase(remaining.begin() + static_cast<std::ptrdiff_t>(it));
+		it = (it + remaining.size() - 1) % remaining.size(); // the previous vertex may have become an ear
+		attempts = 0;
+	}
+
+	if (remaining.size() == 3 && cross(point(remaining[0]), point(remaining[1]), point(remaining[2])) > 0.f) {
+		triangles.insert(triangles.end(), remaining.begin(), remaining.end());
+	}
+	return triangles;
+}
+
+} // namespace Engine::Renderer
@@ -0,0 +1,38 @@
+/*
+    3D Physics Simulations - Polygon: triangulation of simple polygons
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_POLYGON_HPP
+#define SIMULATION_POLYGON_HPP
+
+#include <GLES3/gl3.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// Triangulates a simple polygon of `vx_count` 2D vertices (x, y) by ear clipping, concave polygons are supported
+// The winding does not matter, the triangles are counter clockwise if the polygon is
+// Returns the indices of the triangles in `xy`, collinear vertices produce no triangle
+// A self intersecting polygon is triangulated partially
+std::vector<GLuint> triangulate_polygon(const GLfloat* xy, size_t vx_count);
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_POLYGON_HPP
@@ -0,0 +1,180 @@
+/*
+    3D Physics Simulations - Program cache: on-disk cache of linked program binaries
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "program_cache.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// Header of a binary file, followed by `length` bytes of binary
+struct Binary_header {
+	char magic[8];
+	uint64_t driver_hash;
+	uint64_t source_hash;
+	uint32_t format;
+	uint32_t length;
+};
+
+static constexpr char binary_magic[8] = { 'S', 'I', 'M', 'P', 'R', 'O', 'G', '1' };
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// `shader_cache` next to the executable, or in the working directory if it cannot be found
+static std::string default_directory()
+{
+#ifdef __linux__
+	std::error_code error;
+	const std::filesystem::path executable = std::filesystem::read_symlink("/proc/self/exe", error);
+	if (!error) {
+		return (executable.parent_path() / "shader_cache").string();
+	}
+#endif
+	return "shader_cache";
+}
+
+Program_cache::Program_cache():
+		directory(default_directory()), driver_hash(0), supported(false)
+{
+#ifndef EMSCRIPTEN // WebGL has no program binaries
+	GLint format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	if (format_count > 0) {
+		formats.resize(format_count);
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+	}
+	supported = format_count > 0;
+#endif
+	for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+		const auto* str = reinterpret_cast<const char*>(glGetString(name));
+		driver_hash = hash_bytes(str, str != nullptr ? std::strlen(str) : 0, driver_hash);
+	}
+}
+
+GLuint Program_cache::load(const std::string& vert_src, const std::string& frag_src)
+{
+	auto start = std::chrono::steady_clock::now();
+	const bool enabled = supported && !directory.empty();
+	const uint64_t source_hash = hash_bytes(frag_src.data(), frag_src.size(), hash_bytes(vert_src.data(), vert_src.size()));
+	char file_name[32];
+	std::snprintf(file_name, sizeof(file_name), "%016llx.bin", static_cast<unsigned long long>(source_hash));
+	const std::string path = directory + "/" + file_name;
+
+	if (enabled) {
+		GLuint program = load_binary(path, source_hash);
+		if (program != GL_NONE) {
+			stats.hits++;
+			stats.load_ms += elapsed_ms(start);
+			return program;
+		}
+	}
+
+	GLuint vert_shader = load_shader(vert_src.c_str(), GL_VERTEX_SHADER);
+	GLuint frag_shader = GL_NONE;
+	GLuint program = GL_NONE;
+	try {
+		frag_shader = load_shader(frag_src.c_str(), GL_FRAGMENT_SHADER);
+		program = load_program({vert_shader, frag_shader}, enabled);
+	}
+	catch (...) {
+		glDeleteShader(vert_shader);
+		glDeleteShader(frag_shader);
+		throw;
+	}
+
+	// Flag shaders for deletion
+	glDetachShader(program, vert_shader);
+	glDetachShader(program, frag_shader);
+	glDeleteShader(vert_shader);
+	glDeleteShader(frag_shader);
+
+	if (enabled) {
+		store_binary(path, source_hash, program);
+	}
+	stats.compiled++;
+	stats.compile_ms += elapsed_ms(start);
+	return program;
+}
+
+GLuint Program_cache::load_binary(const std::string& path, uint64_t source_hash) const
+{
+	std::ifstream file(path, std::ios::binary);
+	Binary_header header{};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+	    std::memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 ||
+	    header.driver_hash != driver_hash || header.source_hash != source_hash ||
+	    std::find(formats.begin(), formats.end(), static_cast<GLint>(header.format)) == formats.end()) {
+		return GL_NONE; // glProgramBinary would raise a GL_INVALID_ENUM for an unknown format
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size()))) {
+		return GL_NONE;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint link_status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+	if (link_status == GL_FALSE) { // rejected (eg: driver update without version change), compile it again
+		glDeleteProgram(program);
+		return GL_NONE;
+	}
+	return program;
+}
+
+void Program_cache::store_binary(const std::string& path, uint64_t source_hash, GLuint program) const
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	Binary_header header{};
+	std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+	header.driver_hash = driver_hash;
+	header.source_hash = source_hash;
+	std::vector<char> binary(length);
+	GLenum format = GL_NONE;
+	glGetProgramBinary(program, length, nullptr, &format, binary.data());
+	header.format = format;
+	header.length = static_cast<uint32_t>(length);
+
+	// The cache is an optimisation: failing to write it is not an error
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(binary.data(), length);
+}
+
+Program_cache& Program_cache::get()
+{
+	static Program_cache instance;
+	return instance;
+}
+
+} // namespace Engine::Renderer
@@ -0,0 +1,78 @@
+/*
+    3D Physics Simulations - Program cache: on-disk cache of linked program binaries
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_PROGRAM_CACHE_HPP
+#define SIMULATION_PROGRAM_CACHE_HPP
+
+#include <GLES3/gl3.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// Stores the binaries of the linked programs (glGetProgramBinary) in a directory, one file per pair of shader sources
+// A binary is reloaded (glProgramBinary) if it was produced by the same driver, otherwise or if the driver rejects it,
+// the program is compiled from the sources and its binary replaces the stale one
+// Without support (no binary format, or WebGL) the programs are always compiled
+class Program_cache {
+public:
+	struct Stats {
+		unsigned hits = 0;     // programs loaded from a binary
+		unsigned compiled = 0; // programs compiled (not cached, stale or rejected binary)
+		double load_ms = 0.;    // time spent in hits
+		double compile_ms = 0.; // time spent compiling, linking and storing
+	};
+
+	// Returns the name of a linked program made of these shaders
+	// throws a runtime_exception if the compilation fails
+	GLuint load(const std::string& vert_src, const std::string& frag_src);
+
+	// Directory of the binaries (created if needed), the cache is disabled if empty
+	// `shader_cache` next to the executable by default
+	void set_directory(const std::string& directory) { this->directory = directory; }
+
+	[[nodiscard]] const Stats& get_stats() const { return stats; }
+
+	// Lazy initialised singleton
+	static Program_cache& get();
+
+private:
+	Program_cache();
+	~Program_cache() = default;
+	Program_cache(const Program_cache&) = delete;
+	Program_cache(Program_cache&&) = delete;
+	Program_cache& operator=(const Program_cache&) = delete;
+	Program_cache& operator=(Program_cache&&) = delete;
+
+	// Returns GL_NONE if there is no valid binary for these sources
+	GLuint load_binary(const std::string& path, uint64_t source_hash) const;
+	void store_binary(const std::string& path, uint64_t source_hash, GLuint program) const;
+
+	std::string directory;
+	std::vector<GLint> formats; // binary formats of the driver
+	uint64_t driver_hash; // vendor, renderer and version strings
+	bool supported;
+	Stats stats;
+};
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_PROGRAM_CACHE_HPP
@@ -17,126 +17,255 @@
 */
 #include "utils.hpp"
 #include "renderer.hpp"
+#include "camera.hpp"
+#include "program_cache.hpp"
 
 #include <array>
+#include <string>
+#include <unordered_map>
 
 #include <glm/gtc/type_ptr.hpp>
 
 namespace Engine::Renderer {
 
+// The shaders are specialised by the defines of `shader_defines`
 static constexpr const GLchar* vert_shader_src =
-R"shader(#version 300 es
-
+R"shader(
 layout(location = 0) in highp vec3 vx_pos; // Vertex
-layout(location = 1) in highp vec3 vx_col; // Color
+#ifdef VERTEX_COLOUR
+layout(location = 1) in highp vec4 vx_col; // Color (alpha defaults to 1 for 3 components colours)
+#endif
+#if defined(TEXTURED) && !defined(POINT_SPRITES)
 layout(location = 2) in vec2 vx_uv; // UV
-
-uniform highp mat4 proj_m4;
-uniform highp mat4 view_m4;
+#endif
+#if defined(INSTANCED)
+layout(location = 3) in highp mat4 inst_model_m4; // Instance model matrix (uses locations 3 to 6)
+layout(location = 7) in highp vec4 inst_tint; // Instance colour
+#elif defined(INSTANCED_2D)
+layout(location = 3) in highp vec3 inst_pos_scale; // Instance position (xy) and scale (z)
+layout(location = 7) in highp vec4 inst_tint; // Instance colour
+#else
 uniform highp mat4 model_m4;
-
-out highp vec3 colour;
+#endif
+#ifdef POINT_SPRITES
+uniform highp float point_size;
+#endif
+
+layout(std140) uniform Camera {
+	highp mat4 proj_m4;
+	highp mat4 view_m4;
+	highp mat4 proj_view_m4; // proj_m4 * view_m4
+};
+
+#ifdef VARYING_COLOUR
+out highp vec4 colour;
+#endif
+#if defined(TEXTURED) && !defined(POINT_SPRITES)
 out highp vec2 uv;
+#endif
 
 void main()
 {
-	gl_Position = proj_m4 * view_m4 * model_m4 * vec4(vx_pos, 1.0);
+	// matrix * (matrix * vector): two matrix-vector products instead of a matrix-matrix product
+#if defined(INSTANCED)
+	gl_Position = proj_view_m4 * (inst_model_m4 * vec4(vx_pos, 1.0));
+#elif defined(INSTANCED_2D)
+	gl_Position = proj_view_m4 * vec4(vx_pos.xy * inst_pos_scale.z + inst_pos_scale.xy, vx_pos.z, 1.0);
+#else
+	gl_Position = proj_view_m4 * (model_m4 * vec4(vx_pos, 1.0));
+#endif
+
+#if defined(VERTEX_COLOUR) && (defined(INSTANCED) || defined(INSTANCED_2D))
+	colour = vx_col * inst_tint;
+#elif defined(VERTEX_COLOUR)
 	colour = vx_col;
+#elif defined(VARYING_COLOUR)
+	colour = inst_tint;
+#endif
+
+#ifdef POINT_SPRITES
+	gl_PointSize = point_size;
+#else
 	gl_PointSize = 5.;
+#endif
+#if defined(TEXTURED) && !defined(POINT_SPRITES)
 	uv = vx_uv;
+#endif
 })shader";
 
 static constexpr const GLchar* frag_shader_src =
-R"shader(#version 300 es
-
+R"shader(
 out highp vec4 frag_colour;
 
-in highp vec3 colour;
+#ifdef VARYING_COLOUR
+in highp vec4 colour;
+#endif
+#ifdef TEXTURED
+#ifndef POINT_SPRITES
 in highp vec2 uv;
-
-uniform bool has_tex;
+#endif
 uniform sampler2D tex;
 uniform highp mat3 tex_m3;
+#endif
 uniform highp vec4 tint;
 
 void main()
 {
-	if (has_tex) {
-		highp vec3 tex_coord = tex_m3 * vec3(uv, 1.);
-		frag_colour = texture(tex, tex_coord.st) * tint;
-		// DEBUG to see UV values as RG colors (texture lookup because the shader compiler optimisation removes unused uniforms)
-		// frag_colour = vec4(tex_coord.st, 0., texture(tex, tex_coord.st).a * tint.s);
-	}
-	else {
-		frag_colour = vec4(colour, 1.) * tint;
-	}
+	frag_colour = tint;
+#ifdef VARYING_COLOUR
+	frag_colour *= colour;
+#endif
+#ifdef TEXTURED
+#ifdef POINT_SPRITES
+	highp vec3 tex_coord = tex_m3 * vec3(gl_PointCoord, 1.);
+#else
+	highp vec3 tex_coord = tex_m3 * vec3(uv, 1.);
+#endif
+	frag_colour *= texture(tex, tex_coord.st);
+	// DEBUG to see UV values as RG colors
+	// frag_colour = vec4(tex_coord.st, 0., 1.);
+#endif
 })shader";
 
-Renderer::Renderer()
+// Version directive and defines selecting the features, prepended to the shader sources
+static std::string shader_defines(Renderer::Features features)
 {
-	GLuint vert_shader = load_shader(static_cast<const GLchar*>(vert_shader_src), GL_VERTEX_SHADER);
-	GLuint frag_shader = load_shader(static_cast<const GLchar*>(frag_shader_src), GL_FRAGMENT_SHADER);
+	std::string defines = "#version 300 es\n";
+	if (features & Renderer::textured)      defines += "#define TEXTURED\n";
+	if (features & Renderer::vertex_colour) defines += "#define VERTEX_COLOUR\n";
+	if (features & Renderer::instanced)     defines += "#define INSTANCED\n";
+	if (features & Renderer::instanced_2d)  defines += "#define INSTANCED_2D\n";
+	if (features & Renderer::point_sprites) defines += "#define POINT_SPRITES\n";
+	if (features & (Renderer::vertex_colour | Renderer::instanced | Renderer::instanced_2d)) {
+		defines += "#define VARYING_COLOUR\n";
+	}
+	return defines;
+}
 
-	program = load_program({vert_shader, frag_shader});
+Renderer::Renderer(Features features):
+		features(features)
+{
+	if ((features & instanced) && (features & instanced_2d)) {
+		throw std::runtime_error("Renderer::ctor: instanced and instanced_2d are exclusive");
+	}
 
-	// Flag shaders for deletion
-	glDetachShader(program, vert_shader);
-	glDetachShader(program, frag_shader);
-	glDeleteShader(vert_shader);
-	glDeleteShader(frag_shader);
+	const std::string defines = shader_defines(features);
+	program = Program_cache::get().load(defines + vert_shader_src, defines + frag_shader_src);
 
 	check_gl_error("Renderer::ctor#1");
 
 	// If there is a uniform that you are not using, the driver will optimize your uniform out.
 	// Then `glGetUniformLocation` returns -1.
 
+	// Uniform block shared by all programs
+	GLuint camera_block_idx = glGetUniformBlockIndex(program, "Camera");
+	if (camera_block_idx == GL_INVALID_INDEX) {
+		throw std::runtime_error("GL Error: uniform block not found: Camera");
+	}
+	glUniformBlockBinding(program, camera_block_idx, camera_block_binding);
+
 	// Uniform locations in the vertex shader
-	proj_m4_loc = get_check_uniform(program, "proj_m4");
-	view_m4_loc = get_check_uniform(program, "view_m4");
-	model_m4_loc = get_check_uniform(program, "model_m4");
+	if (!(features & (instanced | instanced_2d))) {
+		model_m4_loc = get_check_uniform(program, "model_m4");
+	}
+	if (features & point_sprites) {
+		point_size_loc = get_check_uniform(program, "point_size");
+	}
 
 	// Uniform locations in the fragment shader
-	has_tex_loc = get_check_uniform(program, "has_tex");
-	tex_loc = get_check_uniform(program, "tex");
-	tex_m3_loc = get_check_uniform(program, "tex_m3");
 	tint_loc = get_check_uniform(program, "tint");
+	if (features & textured) {
+		tex_loc = get_check_uniform(program, "tex");
+		tex_m3_loc = get_check_uniform(program, "tex_m3");
+
+		// The sampler uniform never changes
+		Gl_state::get().use_program(program);
+		glUniform1i(tex_loc, texture_unit_name);
+	}
 
 	check_gl_error("Renderer::ctor#2");
 }
 
+const Renderer& Renderer::get(Features features)
+{
+	static std::unordered_map<Features, Renderer> programs;
+	auto it = programs.find(features);
+	if (it == programs.end()) {
+		it = programs.try_emplace(features, features).first;
+	}
+	return it->second;
+}
+
 Renderer::~Renderer()
 {
 	glDeleteProgram(program);
+	Gl_state::get().deleted_program(program);
 }
 
-void Renderer::set_proj_matrix(const glm::mat4& proj_m4) const
+void Renderer::use_program() const
 {
-	glUniformMatrix4fv(proj_m4_loc, 1, GL_FALSE, glm::value_ptr(proj_m4));
+	Gl_state::get().use_program(program);
 }
 
-void Renderer::set_view_matrix(const glm::mat4& view_m4) const
+void Renderer::set_model_matrix(const glm::mat4 &model_m4) const
 {
-	glUniformMatrix4fv(view_m4_loc, 1, GL_FALSE, glm::value_ptr(view_m4));
+	if (model_m4_loc != -1 && Gl_state::get().update_uniform(this->model_m4, model_m4)) {
+		glUniformMatrix4fv(model_m4_loc, 1, GL_FALSE, glm::value_ptr(model_m4));
+	}
 }
 
-void Renderer::set_model_matrix(const glm::mat4 &model_m4) const
+void Renderer::set_texture_matrix(const glm::mat3& tex_m3) const
 {
-	glUniformMatrix4fv(model_m4_loc, 1, GL_FALSE, glm::value_ptr(model_m4));
+	if (tex_m3_loc != -1 && Gl_state::get().update_uniform(this->tex_m3, tex_m3)) {
+		glUniformMatrix3fv(tex_m3_loc, 1, GL_FALSE, glm::value_ptr(tex_m3));
+	}
 }
 
-void Renderer::set_has_texture(bool has_tex) const
+void Renderer::set_tint_colour(const glm::vec4& tint_col) const
 {
-	glUniform1i(has_tex_loc, has_tex ? GL_TRUE : GL_FALSE);
+	if (Gl_state::get().update_uniform(tint, tint_col)) {
+		glUniform4fv(tint_loc, 1, glm::value_ptr(tint_col));
+	}
 }
 
-void Renderer::set_texture_matrix(const glm::mat3& tex_m3) const
+void Renderer::set_point_size(float size) const
 {
-	glUniformMatrix3fv(tex_m3_loc, 1, GL_FALSE, glm::value_ptr(tex_m3));
+	if (point_size_loc != -1 && Gl_state::get().update_uniform(point_size, size)) {
+		glUniform1f(point_size_loc, size);
+	}
 }
 
-void Renderer::set_tint_colour(const glm::vec4& tint_col) const
+Camera_uniforms::Camera_uniforms():
+		ubo(generateArray<glGenBuffers>())
+{
+	Gl_state& gl_state = Gl_state::get();
+	gl_state.bind_buffer(GL_UNIFORM_BUFFER, ubo);
+	gl_state.buffer_data(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+	gl_state.bind_buffer_base(GL_UNIFORM_BUFFER, Renderer::camera_block_binding, ubo);
+	check_gl_error("Camera_uniforms::ctor");
+}
+
+Camera_uniforms::~Camera_uniforms()
+{
+	glDeleteBuffers(1, &ubo);
+	Gl_state::get().deleted_buffer(ubo);
+}
+
+void Camera_uniforms::update(const Camera& camera)
+{
+	if (block && block->proj_m4 == camera.get_proj_matrix() && block->view_m4 == camera.get_view_matrix()) {
+		return;
+	}
+	block = Block{camera.get_proj_matrix(), camera.get_view_matrix(), camera.get_proj_matrix() * camera.get_view_matrix()};
+
+	Gl_state::get().bind_buffer(GL_UNIFORM_BUFFER, ubo);
+	Gl_state::get().buffer_sub_data(GL_UNIFORM_BUFFER, 0, sizeof(Block), &*block);
+}
+
+Camera_uniforms& Camera_uniforms::get()
 {
-	glUniform4fv(tint_loc, 1, glm::value_ptr(tint_col));
+	static Camera_uniforms instance;
+	return instance;
 }
 
 } // namespace Engine::Renderer
@@ -22,53 +22,114 @@
 
 #include <GLES3/gl3.h>
 #include <glm/mat4x4.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/vec4.hpp>
+
+#include <optional>
 
 namespace Engine::Renderer {
 
+// A shader program specialised for a set of features, the shaders are generated from a single source by
+// #define injection so a program has no dynamic branch and only the inputs and uniforms it uses
 class Renderer {
 public:
-	// Compiles shaders, link program
-	Renderer();
-	// Deletes the program (hence this object is movable but not copyable)
+	// Feature flags, combined in a compact key (see `get`)
+	using Features = unsigned;
+	enum Feature: Features {
+		textured      = 1 << 0, // sampler and texture matrix, UVs from the vertices (or from the point sprites)
+		vertex_colour = 1 << 1, // colour attribute multiplied by the tint
+		instanced     = 1 << 2, // model matrix and tint are instance attributes, see Static_indexed_mesh::draw_instanced
+		instanced_2d  = 1 << 3, // position, uniform scale and tint are instance attributes, see Blitter::discs
+		point_sprites = 1 << 4, // point size is a uniform, textured points use gl_PointCoord
+	};
+	static constexpr Features feature_count = 5;
+
+	// Compiles shaders, link program (`instanced` and `instanced_2d` are exclusive)
+	explicit Renderer(Features features = vertex_colour);
+	// Deletes the program
 	~Renderer();
 
-	// Not copyable, not copy assignable
-	// Movable, move assignable
+	// Not copyable, not movable
 	Renderer(const Renderer &) = delete;
-	Renderer(Renderer &&) = default;
+	Renderer(Renderer &&) = delete;
 	Renderer& operator=(const Renderer&) = delete;
-	Renderer& operator=(Renderer&&) = default;
+	Renderer& operator=(Renderer&&) = delete;
+
+	// Shared programs, compiled on first use (Lazy initialised singletons, one per set of features)
+	static const Renderer& get(Features features);
 
 	// Location of vertex attributes defined in the vertex shader
 	constexpr static GLuint vertex_pos_attr_loc = 0;
 	constexpr static GLuint vertex_col_attr_loc = 1;
 	constexpr static GLuint vertex_uv_attr_loc  = 2;
+	constexpr static GLuint instance_model_attr_loc = 3; // mat4: uses 4 locations
+	constexpr static GLuint instance_pos_scale_attr_loc = 3; // vec3 (instanced_2d): x, y, scale
+	constexpr static GLuint instance_tint_attr_loc  = 7;
 	constexpr static GLuint texture_unit_name = 0; // GL_TEXTURE0 + 0 is bound
+	constexpr static GLuint camera_block_binding = 0; // Uniform buffer binding point of the Camera block (see Camera_uniforms)
+
+	// glUseProgram this renderer's program (skipped if already in use)
+	void use_program() const;
 
-	// glUseProgram this renderer's program
-	void use_program() const { glUseProgram(program); glUniform1i(tex_loc, texture_unit_name); };
+	[[nodiscard]] Features get_features() const { return features; }
 
 	// To use the following functions, this renderer's program must be in use
-	void set_proj_matrix(const glm::mat4& proj_m4) const;
-	void set_view_matrix(const glm::mat4& view_m4) const;
+	// (the projection and view matrices are set through Camera_uniforms)
+	// Setting a uniform of a feature the program does not have is a no-op
 	void set_model_matrix(const glm::mat4& model_m4) const;
-	void set_has_texture(bool has_tex) const;
 	void set_texture_matrix(const glm::mat3& tex_m3) const;
 	void set_tint_colour(const glm::vec4& tint_col) const;
+	void set_point_size(float size) const;
 
 private:
+	const Features features;
 	GLuint program;
 
-	// Location of uniforms
+	// Location of uniforms (-1 if the feature is disabled)
 	// - Vertex shader
-	GLint proj_m4_loc;
-	GLint view_m4_loc;
-	GLint model_m4_loc;
+	GLint model_m4_loc = -1;
+	GLint point_size_loc = -1;
 	// - Fragment shader
-	GLint has_tex_loc;
-	GLint tex_loc;
-	GLint tex_m3_loc;
-	GLint tint_loc;
+	GLint tex_loc = -1;
+	GLint tex_m3_loc = -1;
+	GLint tint_loc = -1;
+
+	// Shadow copies of the uniform values, redundant glUniform* calls are skipped (see Gl_state)
+	mutable std::optional<glm::mat4> model_m4;
+	mutable std::optional<glm::mat3> tex_m3;
+	mutable std::optional<glm::vec4> tint;
+	mutable std::optional<float> point_size;
+};
+
+class Camera;
+
+// Per frame camera data in a uniform buffer (std140 layout), bound to Renderer::camera_block_binding
+// and shared by all the programs
+class Camera_uniforms {
+public:
+	// Uploads the camera matrices and their product (skipped if unchanged), call once per frame
+	void update(const Camera& camera);
+
+	// Lazy initialised singleton
+	static Camera_uniforms& get();
+
+private:
+	Camera_uniforms();
+	~Camera_uniforms();
+	Camera_uniforms(const Camera_uniforms&) = delete;
+	Camera_uniforms(Camera_uniforms&&) = delete;
+	Camera_uniforms& operator=(const Camera_uniforms&) = delete;
+	Camera_uniforms& operator=(Camera_uniforms&&) = delete;
+
+	// Matches the Camera block of the shaders, std140: a mat4 is 4 aligned vec4 columns
+	struct Block {
+		glm::mat4 proj_m4;
+		glm::mat4 view_m4;
+		glm::mat4 proj_view_m4;
+	};
+
+	const GLuint ubo;
+	std::optional<Block> block; // shadow copy of the buffer content
 };
 
 } // namespace Engine::Renderer
@@ -0,0 +1,173 @@
+/*
+    3D Physics Simulations - Stream buffer: ring buffer to stream geometry to the GPU
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stream_buffer.hpp"
+#include "utils.hpp"
+
+#include <cstring>
+
+namespace Engine::Renderer {
+
+constexpr GLuint64 fence_timeout_ns = 1000000000; // 1s, the wait is retried on timeout
+
+Stream_buffer::Stream_buffer(GLenum target, GLsizeiptr capacity):
+		target(target), capacity(capacity), buf(generateArray<glGenBuffers>())
+{
+	// Binding an element array buffer modifies the bound VAO, it may be constructed while a VAO is bound
+	Gl_state& gl_state = Gl_state::get();
+	GLint vao = 0;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+	gl_state.bind_vertex_array(GL_NONE);
+
+	gl_state.bind_buffer(target, buf);
+	gl_state.buffer_data(target, capacity, nullptr, GL_STREAM_DRAW);
+
+	gl_state.bind_vertex_array(vao);
+	check_gl_error("Stream_buffer::ctor");
+}
+
+Stream_buffer::~Stream_buffer()
+{
+	for (auto& fence: fences) {
+		glDeleteSync(fence.second);
+	}
+	glDeleteBuffers(1, &buf);
+	Gl_state::get().deleted_buffer(buf);
+}
+
+void Stream_buffer::wait_for_range(GLintptr begin, GLintptr end)
+{
+	// Regions are fenced in order, waiting for the most recent overlapping region frees all the older ones
+	unsigned long last_frame = 0;
+	bool overlap = false;
+	for (const Region& region: regions) {
+		if (region.begin < end && begin < region.end) {
+			last_frame = region.frame;
+			overlap = true;
+		}
+	}
+	if (!overlap) {
+		return;
+	}
+
+	if (last_frame == frame) {
+		end_frame(); // The current frame overflows the ring
+	}
+
+	while (!fences.empty() && fences.front().first <= last_frame) {
+		GLsync fence = fences.front().second;
+		GLenum res;
+		do {
+			res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, fence_timeout_ns);
+		} while (res == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(fence);
+		fences.erase(fences.begin());
+		if (res == GL_WAIT_FAILED) {
+			check_gl_error("Stream_buffer::wait_for_range");
+		}
+	}
+
+	while (!regions.empty() && regions.front().frame <= last_frame) {
+		regions.erase(regions.begin());
+	}
+}
+
+GLintptr Stream_buffer::push(const void* data, GLsizeiptr size, GLsizeiptr alignment)
+{
+	if (size > capacity) {
+		throw std::runtime_error("Stream_buffer::push: size greater than the capacity");
+	}
+	if (size == 0) {
+		return 0;
+	}
+
+	GLintptr offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > capacity) {
+		offset = 0; // wrap
+	}
+	head = offset + size;
+
+#ifdef EMSCRIPTEN
+	// WebGL2 cannot map buffers, the browser takes care of the synchronisation
+	Gl_state::get().bind_buffer(GL_COPY_WRITE_BUFFER, buf);
+	Gl_state::get().buffer_sub_data(GL_COPY_WRITE_BUFFER, offset, size, data);
+#else
+	wait_for_range(offset, offset + size);
+
+	if (!regions.empty() && regions.back().frame == frame && regions.back().end <= offset) {
+		regions.back().end = offset + size;
+	}
+	else {
+		regions.push_back({offset, offset + size, frame});
+	}
+
+	// The copy write target does not interfere with the bound VAO
+	Gl_state::get().bind_buffer(GL_COPY_WRITE_BUFFER, buf);
+	void* dst = Gl_state::get().map_buffer_range(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dst == nullptr) {
+		check_gl_error("Stream_buffer::push");
+		throw std::runtime_error("Stream_buffer::push: cannot map buffer");
+	}
+	std::memcpy(dst, data, size);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+#endif
+
+	return offset;
+}
+
+void Stream_buffer::end_frame()
+{
+	if (!regions.empty() && regions.back().frame == frame) {
+		fences.emplace_back(frame, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+	}
+	frame++;
+
+	// Releases the frames the GPU is done with without waiting, keeps the bookkeeping to the frames in flight
+	unsigned long retired_frame = 0;
+	bool retired = false;
+	while (!fences.empty()) {
+		GLenum res = glClientWaitSync(fences.front().second, 0, 0);
+		if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) {
+			break;
+		}
+		glDeleteSync(fences.front().second);
+		retired_frame = fences.front().first;
+		retired = true;
+		fences.erase(fences.begin());
+	}
+	if (retired) {
+		auto it = regions.begin();
+		while (it != regions.end() && it->frame <= retired_frame) {
+			++it;
+		}
+		regions.erase(regions.begin(), it);
+	}
+}
+
+Stream_buffer& Stream_buffer::vertices()
+{
+	static Stream_buffer instance(GL_ARRAY_BUFFER, 8 << 20);
+	return instance;
+}
+
+Stream_buffer& Stream_buffer::indices()
+{
+	static Stream_buffer instance(GL_ELEMENT_ARRAY_BUFFER, 4 << 20);
+	return instance;
+}
+
+} // namespace Engine::Renderer
@@ -0,0 +1,88 @@
+/*
+    3D Physics Simulations - Stream buffer: ring buffer to stream geometry to the GPU
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_STREAM_BUFFER_HPP
+#define SIMULATION_STREAM_BUFFER_HPP
+
+#include <GLES3/gl3.h>
+
+#include <vector>
+
+namespace Engine::Renderer {
+
+// A large GL buffer sub-allocated as a ring, to stream data that is used once (e.g. each frame)
+// Writes are unsynchronised, regions still in use by the GPU are protected by fences (one per frame)
+// Data must be consumed by a draw call before the next allocation in the same stream buffer
+class Stream_buffer {
+public:
+	// target: GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER, capacity in bytes
+	Stream_buffer(GLenum target, GLsizeiptr capacity);
+	~Stream_buffer();
+	Stream_buffer(const Stream_buffer&) = delete;
+	Stream_buffer(Stream_buffer&&) = delete;
+	Stream_buffer& operator=(const Stream_buffer&) = delete;
+	Stream_buffer& operator=(Stream_buffer&&) = delete;
+
+	// Copies `size` bytes into the ring and returns their offset in the buffer,
+	// waits for the GPU only if the ring is full of in flight data
+	// throws a runtime_exception if size is greater than the capacity
+	GLintptr push(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16);
+
+	template<typename T, typename A>
+	GLintptr push(const std::vector<T, A>& data, GLsizeiptr alignment = 16)
+	{
+		return push(data.data(), data.size() * sizeof(T), alignment);
+	}
+
+	// Fences the regions written since the last call and releases those the GPU has finished reading,
+	// call once per frame after the draw calls
+	void end_frame();
+
+	[[nodiscard]] GLuint get_buffer_name() const { return buf; }
+	[[nodiscard]] GLenum get_target() const { return target; }
+	[[nodiscard]] GLsizeiptr get_capacity() const { return capacity; }
+
+	// Shared stream buffers, to be used by every streaming call site (Lazy initialised singletons)
+	static Stream_buffer& vertices();
+	static Stream_buffer& indices();
+
+private:
+	// Range of the buffer written during a frame (a frame may have 2 regions if the ring wrapped)
+	struct Region {
+		GLintptr begin, end;
+		unsigned long frame;
+	};
+
+	// Waits until no in flight region overlaps the given range, then releases them
+	void wait_for_range(GLintptr begin, GLintptr end);
+
+	const GLenum target;
+	const GLsizeiptr capacity;
+	const GLuint buf;
+
+	GLintptr head = 0;
+	unsigned long frame = 0; // current frame number
+	// A few frames in flight: vectors keep their storage, where deques allocate as they move
+	std::vector<Region> regions; // oldest first
+	std::vector<std::pair<unsigned long, GLsync>> fences; // frame number, fence; oldest first
+};
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_STREAM_BUFFER_HPP
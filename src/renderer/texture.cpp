@@ -16,9 +16,19 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "texture.hpp"
+#include "gl_state.hpp"
+#include "ktx.hpp"
 
 #include <stb_image.h>
 
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#ifdef EMSCRIPTEN
+#include <emscripten/html5.h>
+#endif
+
 namespace Engine::Renderer {
 
 Image::Image(const std::string& filename):
@@ -57,6 +67,8 @@ Image& Image::operator=(Image&& other) noexcept
 	height = other.height;
 	channels = other.channels;
 	raster = other.raster;
+	row_align = other.row_align;
+	deleter = other.deleter;
 	other.raster = nullptr;
 	return *this;
 }
@@ -69,43 +81,157 @@ void Image::init()
 static const unsigned char colours[4] = { 0, 0xFF, 0xFF, 0 };
 const Image bw_checker(2, 2, 1, const_cast<unsigned char*>(colours));
 
+Compressed_image::Compressed_image(const std::string& filename):
+		internal_format(GL_NONE)
+{
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if (!file) {
+		throw std::runtime_error("Compressed_image::ctor: Could not open file " + filename);
+	}
+	data.resize(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	if (!file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()))) {
+		throw std::runtime_error("Compressed_image::ctor: Could not read file " + filename);
+	}
+
+	Ktx::Header header{};
+	if (data.size() < sizeof(header)) {
+		throw std::runtime_error("Compressed_image::ctor: Truncated KTX header in " + filename);
+	}
+	std::memcpy(&header, data.data(), sizeof(header));
+	if (std::memcmp(header.identifier, Ktx::identifier, sizeof(Ktx::identifier)) != 0 || header.endianness != Ktx::endianness) {
+		throw std::runtime_error("Compressed_image::ctor: Not a native endian KTX file " + filename);
+	}
+	if (header.gl_type != 0 || header.pixel_depth > 1 || header.array_elements > 0 || header.faces != 1) {
+		throw std::runtime_error("Compressed_image::ctor: Only compressed 2D KTX textures are supported " + filename);
+	}
+	internal_format = header.gl_internal_format;
+
+	size_t offset = sizeof(header) + header.key_value_bytes;
+	int width = static_cast<int>(header.pixel_width);
+	int height = static_cast<int>(header.pixel_height);
+	for (uint32_t it = 0; it < std::max(header.mipmap_levels, 1u); ++it) {
+		uint32_t size = 0;
+		if (offset + sizeof(size) > data.size()) {
+			throw std::runtime_error("Compressed_image::ctor: Truncated KTX file " + filename);
+		}
+		std::memcpy(&size, data.data() + offset, sizeof(size));
+		offset += sizeof(size);
+		if (offset + size > data.size()) {
+			throw std::runtime_error("Compressed_image::ctor: Truncated KTX file " + filename);
+		}
+		levels.push_back({width, height, offset, size});
+		offset += (size + 3) & ~size_t(3); // mip padding
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+}
+
 Texture::Texture(const Image& image, GLenum filtering, GLenum wrapping):
 		dimensions(image.get_width(), image.get_height())
 {
 	if (image.get_raster() == nullptr) {
 		throw std::runtime_error("Texture::ctor: Cannot create from empty Image");
 	}
+	create(image.get_channels(), filtering, wrapping, image.get_row_align(), image.get_raster());
+}
+
+Texture::Texture(int width, int height, int channels, GLenum filtering, GLenum wrapping):
+		dimensions(width, height)
+{
+	create(channels, filtering, wrapping, 1, nullptr);
+}
+
+Texture::Texture(const Compressed_image& image, GLenum filtering, GLenum wrapping):
+		dimensions(image.get_width(), image.get_height()), format(image.get_internal_format())
+{
+	const std::vector<Compressed_image::Level>& levels = image.get_levels();
+	if (levels.size() == 1 && is_mipmap_filter(filtering)) {
+		filtering = (filtering == GL_NEAREST_MIPMAP_NEAREST || filtering == GL_NEAREST_MIPMAP_LINEAR) ? GL_NEAREST : GL_LINEAR;
+	}
+	create_name(filtering, wrapping);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()) - 1);
+
+	for (size_t level = 0; level < levels.size(); ++level) {
+		Gl_state::get().compressed_tex_image_2d(static_cast<GLint>(level), format, levels[level].width, levels[level].height,
+		                       static_cast<GLsizei>(levels[level].size), image.get_level_data(level));
+	}
+}
+
+bool Texture::is_mipmap_filter(GLenum filtering)
+{
+	return filtering == GL_NEAREST_MIPMAP_NEAREST || filtering == GL_NEAREST_MIPMAP_LINEAR ||
+	       filtering == GL_LINEAR_MIPMAP_NEAREST || filtering == GL_LINEAR_MIPMAP_LINEAR;
+}
+
+bool Texture::supports_compressed()
+{
+#ifdef EMSCRIPTEN
+	static const bool supported = emscripten_webgl_enable_extension(emscripten_webgl_get_current_context(), "WEBGL_compressed_texture_etc");
+	return supported;
+#else
+	return true; // ETC2/EAC are core in GLES3
+#endif
+}
+
+void Texture::create_name(GLenum filtering, GLenum wrapping)
+{
+	mipmapped = is_mipmap_filter(filtering);
+	const GLenum mag_filter = (filtering == GL_NEAREST || filtering == GL_NEAREST_MIPMAP_NEAREST || filtering == GL_NEAREST_MIPMAP_LINEAR) ? GL_NEAREST : GL_LINEAR;
+
 	glGenTextures(1, &texture_name);
-	glBindTexture(GL_TEXTURE_2D, texture_name);
+	Gl_state::get().bind_texture(texture_name);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapping);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapping);
+}
+
+void Texture::create(int channels, GLenum filtering, GLenum wrapping, int row_align, const void* pixels)
+{
+	create_name(filtering, wrapping);
 
-	glPixelStorei(GL_UNPACK_ALIGNMENT, image.get_row_align());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, row_align);
 
-	GLenum format = GL_NONE;
 	GLenum internal_format = GL_NONE;
-	switch (image.get_channels()) {
+	switch (channels) {
 		case 1: internal_format = GL_R8; format = GL_RED; break; // GL_LUMINANCE deprecated
 		case 2: internal_format = GL_RG8; format = GL_RG; break; // GL_LUMINANCE_ALPHA deprecated
 		case 3: internal_format = GL_RGB8; format = GL_RGB; break;
 		default: internal_format = GL_RGBA8; format = GL_RGBA;
 	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, image.get_width(), image.get_height(), 0, format, GL_UNSIGNED_BYTE, image.get_raster());
-	glBindTexture(GL_TEXTURE_2D, GL_NONE);
+	Gl_state::get().tex_image_2d(0, internal_format, get_width(), get_height(), format, GL_UNSIGNED_BYTE, pixels);
+	if (mipmapped && pixels != nullptr) {
+		Gl_state::get().generate_mipmap();
+	}
+}
+
+void Texture::upload(int first_row, int row_count, const void* pixels, int row_align) const
+{
+	Gl_state::get().bind_texture(texture_name);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, row_align);
+	Gl_state::get().tex_sub_image_2d(0, 0, first_row, get_width(), row_count, format, GL_UNSIGNED_BYTE, pixels);
+}
+
+void Texture::generate_mipmaps() const
+{
+	Gl_state::get().bind_texture(texture_name);
+	Gl_state::get().generate_mipmap();
 }
 
 Texture& Texture::operator=(Texture&& other) noexcept
 {
 	if (texture_name != GL_NONE && texture_name != other.texture_name) {
 		glDeleteTextures(1, &texture_name);
+		Gl_state::get().deleted_texture(texture_name);
 	}
 	texture_name = other.texture_name;
 	other.texture_name = GL_NONE;
 	dimensions = other.dimensions;
+	format = other.format;
+	mipmapped = other.mipmapped;
 	return *this;
 }
 
@@ -113,6 +239,7 @@ Texture::~Texture()
 {
 	if (texture_name != GL_NONE) {
 		glDeleteTextures(1, &texture_name);
+		Gl_state::get().deleted_texture(texture_name);
 	}
 }
 
@@ -24,6 +24,8 @@
 
 #include <glm/vec2.hpp>
 
+#include <vector>
+
 namespace Engine::Renderer {
 
 class Image {
@@ -36,7 +38,8 @@ public:
 	Image(int width, int height, int channels, unsigned char* raster, int row_align = 1, void (*del)(unsigned char*) = nullptr);
 
 	// move
-	Image(Image&& other) noexcept { *this = std::move(other); };
+	Image(Image&& other) noexcept:
+			width(0), height(0), channels(0), raster(nullptr), row_align(1), deleter(nullptr) { *this = std::move(other); };
 	Image& operator=(Image&&) noexcept;
 
 	// dtor
@@ -62,13 +65,57 @@ private:
 
 extern const Image bw_checker;
 
+// A block compressed image (ETC2/EAC) with its mip chain, loaded from a KTX file (see tools/texconv)
+class Compressed_image {
+public:
+	struct Level {
+		int width, height;
+		size_t offset, size; // in `data`
+	};
+
+	// Reads the whole file at once, the levels point into it
+	Compressed_image(const std::string& filename);
+
+	[[nodiscard]] int get_width() const { return levels.front().width; }
+	[[nodiscard]] int get_height() const { return levels.front().height; }
+	[[nodiscard]] GLenum get_internal_format() const { return internal_format; }
+	[[nodiscard]] const std::vector<Level>& get_levels() const { return levels; }
+	[[nodiscard]] const unsigned char* get_level_data(size_t level) const { return data.data() + levels[level].offset; }
+
+private:
+	GLenum internal_format;
+	std::vector<Level> levels;
+	std::vector<unsigned char> data;
+};
+
+// `filtering` is the minifying filter, a mipmap filter (eg: GL_LINEAR_MIPMAP_LINEAR) gives the texture a mip chain
+// the magnifying filter is the matching GL_NEAREST or GL_LINEAR
 class Texture {
 public:
 	// Create a Texture from an Image (Copies the image into the VRAM, then the client side image can safely be destructed)
 	Texture(const Image& image, GLenum filtering = GL_NEAREST, GLenum wrapping = GL_REPEAT);
 
+	// Create an uninitialised Texture, its content is set by `upload`
+	Texture(int width, int height, int channels, GLenum filtering = GL_NEAREST, GLenum wrapping = GL_REPEAT);
+
+	// Create a Texture from a compressed image, its mip chain is uploaded as is
+	// (ETC2 is core in GLES3, WebGL2 requires the WEBGL_compressed_texture_etc extension)
+	Texture(const Compressed_image& image, GLenum filtering = GL_LINEAR_MIPMAP_LINEAR, GLenum wrapping = GL_REPEAT);
+
+	// Uploads `row_count` rows of pixels starting at `first_row`, the number of channels is the one given at construction
+	// `pixels` is an offset in the buffer if a GL_PIXEL_UNPACK_BUFFER is bound
+	void upload(int first_row, int row_count, const void* pixels, int row_align = 1) const;
+
+	// Regenerates the mip chain from level 0, call after the last `upload` of a mipmapped texture
+	void generate_mipmaps() const;
+
+	[[nodiscard]] static bool is_mipmap_filter(GLenum filtering);
+
+	// Whether the compressed formats of Compressed_image can be used (enables the WebGL2 extension), GL thread only
+	[[nodiscard]] static bool supports_compressed();
+
 	// move
-	Texture(Texture&& other) noexcept { *this = std::move(other); }
+	Texture(Texture&& other) noexcept: texture_name(GL_NONE), format(GL_NONE), mipmapped(false) { *this = std::move(other); }
 	Texture& operator=(Texture&&) noexcept;
 
 	// no copy
@@ -82,10 +129,18 @@ public:
 	[[nodiscard]] int get_width() const { return dimensions.x; }
 	[[nodiscard]] int get_height() const { return dimensions.y; }
 	[[nodiscard]] glm::vec2 get_dimensions() const { return dimensions; }
+	[[nodiscard]] bool has_mipmaps() const { return mipmapped; }
 
 private:
+	// Creates the texture name and sets its sampling parameters
+	void create_name(GLenum filtering, GLenum wrapping);
+	// Creates the texture name and allocates the storage
+	void create(int channels, GLenum filtering, GLenum wrapping, int row_align, const void* pixels);
+
 	glm::vec2 dimensions;
 	GLuint texture_name;
+	GLenum format; // pixel format of the uploaded data
+	bool mipmapped = false;
 };
 
 } // namespace Engine::Renderer
@@ -0,0 +1,218 @@
+/*
+    3D Physics Simulations - Texture loader: asynchronous image decoding and texture upload
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "texture_loader.hpp"
+#include "utils.hpp"
+#include "gl_state.hpp"
+#include "../profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace Engine::Renderer {
+
+const Texture& Async_texture::placeholder()
+{
+	static Texture instance(bw_checker);
+	return instance;
+}
+
+Texture_loader::Texture_loader(unsigned worker_count, size_t upload_budget):
+		upload_budget(upload_budget)
+{
+#ifndef EMSCRIPTEN // no threads: images are decoded by `load()`
+	for (unsigned it = 0; it < worker_count; it++) {
+		workers.emplace_back(&Texture_loader::worker_run, this);
+	}
+#endif
+}
+
+Texture_loader::~Texture_loader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	cond.notify_all();
+	for (std::thread& worker: workers) {
+		worker.join();
+	}
+	for (Upload& upload: uploads) {
+		glDeleteBuffers(1, &upload.pbo);
+		Gl_state::get().deleted_buffer(upload.pbo);
+	}
+}
+
+void Texture_loader::decode(Job& job)
+{
+	PROFILE_SCOPE("Texture_loader::decode");
+	if (job.try_compressed) {
+		try {
+			job.compressed.emplace(job.filename.substr(0, job.filename.size() - 4) + ".ktx");
+			return;
+		}
+		catch (const std::runtime_error&) {
+			// Missing or invalid, falls back to the PNG
+		}
+	}
+	try {
+		job.image.emplace(job.filename);
+	}
+	catch (...) {
+		job.error = std::current_exception();
+	}
+}
+
+void Texture_loader::worker_run()
+{
+	PROFILE_THREAD("Texture_loader");
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		cond.wait(lock, [this]() { return quit || !pending.empty(); });
+		if (quit) {
+			return;
+		}
+		Job job = std::move(pending.front());
+		pending.pop_front();
+
+		lock.unlock();
+		decode(job);
+		lock.lock();
+
+		decoded.push_back(std::move(job));
+	}
+}
+
+std::shared_ptr<Async_texture> Texture_loader::load(const std::string& filename, GLenum filtering, GLenum wrapping, Callback on_ready)
+{
+	auto res = std::make_shared<Async_texture>();
+	const bool png = filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".png") == 0;
+	Job job{filename, filtering, wrapping, std::move(on_ready), res, png && Texture::supports_compressed(), std::nullopt, std::nullopt, nullptr};
+#ifdef EMSCRIPTEN
+	decode(job);
+	decoded.push_back(std::move(job));
+#else
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(std::move(job));
+	}
+	cond.notify_one();
+#endif
+	return res;
+}
+
+void Texture_loader::update()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!decoded.empty()) {
+			uploads.push_back({std::move(decoded.front()), std::nullopt, GL_NONE, 0});
+			decoded.pop_front();
+		}
+	}
+
+	// Hands the uploaded texture of the first upload to its target
+	auto complete = [this]() {
+		Upload& upload = uploads.front();
+		std::shared_ptr<Async_texture> target = upload.job.target.lock();
+		target->texture = std::move(upload.texture);
+		target->ready = true;
+		Callback on_ready = std::move(upload.job.on_ready);
+		uploads.pop_front();
+		if (on_ready) {
+			on_ready(*target->texture);
+		}
+	};
+
+	Gl_state& gl_state = Gl_state::get();
+	size_t budget = upload_budget;
+	while (!uploads.empty() && budget > 0) {
+		Upload& upload = uploads.front();
+		if (upload.job.error) {
+			std::exception_ptr error = upload.job.error;
+			uploads.pop_front();
+			std::rethrow_exception(error);
+		}
+		if (upload.job.target.expired()) { // nobody wants it anymore
+			glDeleteBuffers(1, &upload.pbo);
+			gl_state.deleted_buffer(upload.pbo);
+			uploads.pop_front();
+			continue;
+		}
+
+		if (upload.job.compressed) {
+			// The mip chain is uploaded at once, it is a fraction of the uncompressed size
+			const Compressed_image& compressed = *upload.job.compressed;
+			upload.texture.emplace(compressed, upload.job.filtering, upload.job.wrapping);
+			for (const Compressed_image::Level& level: compressed.get_levels()) {
+				budget -= std::min(budget, level.size);
+			}
+			complete();
+			continue;
+		}
+
+		const Image& image = *upload.job.image;
+		const int align = image.get_row_align();
+		const size_t pitch = (image.get_width() * image.get_channels() + align - 1) / align * align;
+		if (!upload.texture) {
+			upload.texture.emplace(image.get_width(), image.get_height(), image.get_channels(), upload.job.filtering, upload.job.wrapping);
+			glGenBuffers(1, &upload.pbo);
+			gl_state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+			gl_state.buffer_data(GL_PIXEL_UNPACK_BUFFER, pitch * image.get_height(), nullptr, GL_STREAM_DRAW);
+		}
+
+		// Upload a band of rows through the PBO, the copy to the texture is done asynchronously by the driver
+		const int rows = std::clamp(static_cast<int>(budget / pitch), 1, image.get_height() - upload.next_row);
+		const size_t offset = upload.next_row * pitch;
+		gl_state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, upload.pbo);
+#ifdef EMSCRIPTEN
+		// WebGL2 cannot map buffers
+		gl_state.buffer_sub_data(GL_PIXEL_UNPACK_BUFFER, offset, rows * pitch, image.get_raster() + offset);
+#else
+		// Each band is written once: no need to synchronise with the transfers of the previous bands
+		void* dst = gl_state.map_buffer_range(GL_PIXEL_UNPACK_BUFFER, offset, rows * pitch, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (dst == nullptr) {
+			check_gl_error("Texture_loader::update");
+			throw std::runtime_error("Texture_loader::update: cannot map the pixel buffer");
+		}
+		std::memcpy(dst, image.get_raster() + offset, rows * pitch);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+#endif
+		upload.texture->upload(upload.next_row, rows, reinterpret_cast<const void*>(offset), align);
+		gl_state.bind_buffer(GL_PIXEL_UNPACK_BUFFER, GL_NONE); // Other uploads read client memory
+		upload.next_row += rows;
+		budget -= std::min(budget, rows * pitch);
+
+		if (upload.next_row == image.get_height()) {
+			glDeleteBuffers(1, &upload.pbo);
+			gl_state.deleted_buffer(upload.pbo);
+			if (upload.texture->has_mipmaps()) {
+				upload.texture->generate_mipmaps();
+			}
+			complete();
+		}
+	}
+}
+
+Texture_loader& Texture_loader::get()
+{
+	static Texture_loader instance;
+	return instance;
+}
+
+} // namespace Engine::Renderer
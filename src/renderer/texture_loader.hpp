@@ -0,0 +1,117 @@
+/*
+    3D Physics Simulations - Texture loader: asynchronous image decoding and texture upload
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_TEXTURE_LOADER_HPP
+#define SIMULATION_TEXTURE_LOADER_HPP
+
+#include "texture.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Engine::Renderer {
+
+// A texture that shows a placeholder (bw_checker) until it is loaded by the Texture_loader
+class Async_texture {
+public:
+	// The placeholder until ready, do not keep the reference across frames
+	[[nodiscard]] const Texture& get() const { return ready ? *texture : placeholder(); }
+	[[nodiscard]] bool is_ready() const { return ready; }
+
+	// Shared by every pending texture, created on first use (GL thread only)
+	static const Texture& placeholder();
+
+private:
+	friend class Texture_loader;
+	std::optional<Texture> texture;
+	bool ready = false;
+};
+
+// Decodes images on worker threads, then uploads them through a pixel buffer object, spread across frames
+// Each band of rows is copied into the mapped PBO, the driver then transfers it to the texture asynchronously
+// A PNG with a precompressed KTX next to it (see `make textures`) is loaded from the KTX when the GL supports it
+class Texture_loader {
+public:
+	using Callback = std::function<void(const Texture&)>;
+
+	// upload_budget: maximum number of bytes uploaded per frame (at least one row of an image is uploaded)
+	explicit Texture_loader(unsigned worker_count = 2, size_t upload_budget = 4 << 20);
+	// Joins the workers
+	~Texture_loader();
+	Texture_loader(const Texture_loader&) = delete;
+	Texture_loader(Texture_loader&&) = delete;
+	Texture_loader& operator=(const Texture_loader&) = delete;
+	Texture_loader& operator=(Texture_loader&&) = delete;
+
+	// Queues the image file for loading, `on_ready` is called from `update()` once the texture is uploaded
+	std::shared_ptr<Async_texture> load(const std::string& filename, GLenum filtering = GL_NEAREST, GLenum wrapping = GL_REPEAT, Callback on_ready = {});
+
+	// Uploads the decoded images within the budget, call once per frame from the GL thread
+	// rethrows the exception of a failed decoding
+	void update();
+
+	// Shared loader, updated by the main loop (Lazy initialised singleton)
+	static Texture_loader& get();
+
+private:
+	struct Job {
+		std::string filename;
+		GLenum filtering, wrapping;
+		Callback on_ready;
+		std::weak_ptr<Async_texture> target;
+		bool try_compressed; // load the KTX next to the PNG, if any
+		std::optional<Image> image; // set once decoded, or
+		std::optional<Compressed_image> compressed;
+		std::exception_ptr error;
+	};
+
+	// A texture being uploaded (GL thread only)
+	struct Upload {
+		Job job;
+		std::optional<Texture> texture;
+		GLuint pbo = GL_NONE;
+		int next_row = 0;
+	};
+
+	void worker_run();
+	static void decode(Job& job);
+
+	const size_t upload_budget;
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool quit = false;
+	std::deque<Job> pending; // to decode
+	std::deque<Job> decoded; // to upload
+	std::vector<std::thread> workers;
+
+	std::deque<Upload> uploads;
+};
+
+} // namespace Engine::Renderer
+
+#endif //SIMULATION_TEXTURE_LOADER_HPP
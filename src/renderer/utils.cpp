@@ -17,6 +17,8 @@
 */
 #include "utils.hpp"
 
+#include "gl_debug.hpp"
+
 #include <iostream>
 
 using std::literals::string_literals::operator""s;
@@ -25,6 +27,19 @@ constexpr GLsizei log_buf_size = 4096;
 
 namespace Engine::Renderer {
 
+#ifndef NDEBUG
+void check_gl_error(const char* where)
+{
+	if (Gl_debug::get().is_async()) {
+		return;
+	}
+	GLenum error = glGetError();
+	if (error != GL_NO_ERROR) {
+		throw std::runtime_error("GL Error: "s + gl_error_string(error) + ", at " + where);
+	}
+}
+#endif
+
 GLuint load_shader(const GLchar* source, GLenum type)
 {
 	GLuint shader = glCreateShader(type);
@@ -43,21 +58,27 @@ GLuint load_shader(const GLchar* source, GLenum type)
 }
 
 // Create a program from all the supplied shaders
-GLuint load_program(std::initializer_list<GLuint> shaders)
+GLuint load_program(std::initializer_list<GLuint> shaders, bool retrievable)
 {
 	GLuint program = glCreateProgram();
 	for (GLuint it: shaders) {
 		glAttachShader(program, it);
 	}
+	if (retrievable) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	glLinkProgram(program);
 
 	GLint link_status = GL_FALSE;
 	glGetProgramiv(program, GL_LINK_STATUS, &link_status);
-	GLint validate_status = GL_FALSE;
+	GLint validate_status = GL_TRUE;
+#ifndef NDEBUG
+	// Validation depends on the current state and is slow, only to debug
 	if (link_status == GL_TRUE) {
 		glValidateProgram(program);
 		glGetProgramiv(program, GL_VALIDATE_STATUS, &validate_status);
 	}
+#endif
 
 	if (link_status == GL_FALSE || validate_status == GL_FALSE) {
 		GLchar log[log_buf_size];
@@ -20,13 +20,15 @@
 #ifndef SIMULATION_UTILS_HPP
 #define SIMULATION_UTILS_HPP
 
-#include <sstream>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 #include <GLES3/gl3.h>
 
+#include "gl_state.hpp"
+
 constexpr float PI         = 3.141592653589793f; // acos(-1.f)
 constexpr float PI_2       = 6.283185307179586f; // 2*acos(-1)
 constexpr float PI_HALF    = 1.5707963267948966; // acos(-1)/2.f
@@ -38,33 +40,22 @@ constexpr float PI_2THIRD  = 2.0943951023931953; // 2*acos(-1)/3.f
 namespace Engine::Renderer {
 
 // Checks whether an error occurred in the GL calls performed until now
+// compiled out of release builds, and does nothing if the errors are reported asynchronously (see Gl_debug)
 // throws a runtime_exception
-inline void check_gl_error(const std::string& where)
-{
-	GLenum error = glGetError();
-	if (error != GL_NO_ERROR) {
-		std::stringstream msg;
-		msg << "GL Error: ";
-		switch (error) {
-			case GL_INVALID_ENUM:                  msg << "invalid enum value";                   break;
-			case GL_INVALID_VALUE:                 msg << "invalid argument";                     break;
-			case GL_INVALID_OPERATION:             msg << "operation not allowed";                break;
-			case GL_INVALID_FRAMEBUFFER_OPERATION: msg << "framebuffer operation not allowed";    break;
-			case GL_OUT_OF_MEMORY:                 msg << "OUT OF MEMORY";                        break; // this error is fatal to the GL state
-			default:                               msg << "unknown error: " << error;
-		}
-		msg << ", at " << where;
-		throw std::runtime_error(msg.str());
-	}
-}
+#ifdef NDEBUG
+inline void check_gl_error([[maybe_unused]] const char* where) {}
+#else
+void check_gl_error(const char* where);
+#endif
 
 // Loads the given Shader from source, and return its GL name
 // throws a runtime_exception on failure
 GLuint load_shader(const GLchar* source, GLenum type);
 
 // Links all the given shaders into a program and return its GL name
+// `retrievable`: the binary of the program can be retrieved with glGetProgramBinary (see Program_cache)
 // throws a runtime_exception on failure
-GLuint load_program(std::initializer_list<GLuint> shaders);
+GLuint load_program(std::initializer_list<GLuint> shaders, bool retrievable = false);
 
 // Get the location of a named uniform in a program
 // throws a runtime_exception if not found
@@ -73,6 +64,16 @@ GLint get_check_uniform(GLuint program, const GLchar* uniform_name);
 // List uniform names on std::cerr, for debugging purposes
 void list_uniforms(GLuint program);
 
+// FNV-1a hash of `size` bytes, pass the previous hash as `seed` to hash several blocks
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325)
+{
+	const auto* bytes = static_cast<const unsigned char*>(data);
+	for (size_t it = 0; it < size; it++) {
+		seed = (seed ^ bytes[it]) * 0x100000001b3;
+	}
+	return seed;
+}
+
 // Generates a single Buffer or VAO name (does nothing and returns GL_NONE if parameter==false)
 // Template parameter should be either glGenBuffers or glGenVertexArrays
 template<void (*G)(int, GLuint*)>
@@ -90,8 +91,8 @@ template<GLuint TargetT, GLuint UsageT, GLint CompNumber = 3, GLboolean Normaliz
 void transfer_geometry(GLuint vextex_attrib_loc, GLuint target_buf, const std::vector<GlT>& data, GLsizei stride = 0, const void* pointer = nullptr)
 {
     glEnableVertexAttribArray(vextex_attrib_loc);
-    glBindBuffer(TargetT, target_buf);
-    glBufferData(TargetT, data.size() * sizeof(GlT), data.data(), UsageT);
+    Gl_state::get().bind_buffer(TargetT, target_buf);
+    Gl_state::get().buffer_data(TargetT, data.size() * sizeof(GlT), data.data(), UsageT);
     glVertexAttribPointer(vextex_attrib_loc, CompNumber, DataT, Normalized, stride, pointer);
 }
 
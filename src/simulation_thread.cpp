@@ -0,0 +1,107 @@
+/*
+    3D Physics Simulations - Simulation thread: runs the context updates concurrently with the rendering
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "simulation_thread.hpp"
+#include "context.hpp"
+#include "profiler.hpp"
+
+#include <imgui/imgui.h>
+
+#include <chrono>
+
+namespace Engine {
+
+using Clock = std::chrono::steady_clock;
+
+Simulation_thread::~Simulation_thread()
+{
+	stop();
+}
+
+void Simulation_thread::start(Context* ctx, const Fixed_timestep& timestep)
+{
+	stop();
+	context = ctx;
+	set_timestep(timestep);
+	quit.store(false);
+	thread = std::thread(&Simulation_thread::run, this, timestep);
+}
+
+void Simulation_thread::stop()
+{
+	if (thread.joinable()) {
+		quit.store(true);
+		thread.join();
+	}
+	context = nullptr;
+}
+
+void Simulation_thread::set_timestep(const Fixed_timestep& timestep)
+{
+	step.store(timestep.get_step(), std::memory_order_relaxed);
+	max_steps.store(timestep.get_max_steps(), std::memory_order_relaxed);
+}
+
+Simulation_thread::Stats Simulation_thread::get_stats() const
+{
+	return {steps.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed), update_ms.load(std::memory_order_relaxed)};
+}
+
+void Simulation_thread::draw_window()
+{
+	if (ImGui::Begin("Simulation")) {
+#ifndef EMSCRIPTEN
+		ImGui::Checkbox("Simulation thread", &enabled);
+#endif
+		if (context != nullptr) {
+			const Stats stats = get_stats();
+			ImGui::Text("thread: %llu steps, last %.2fms, %.1fms dropped", static_cast<unsigned long long>(stats.steps), stats.update_ms, stats.dropped * 1e3f);
+		}
+	}
+	ImGui::End();
+}
+
+void Simulation_thread::run(Fixed_timestep timestep)
+{
+	PROFILE_THREAD("Simulation");
+	Clock::time_point last = Clock::now();
+	while (!quit.load(std::memory_order_relaxed)) {
+		if (timestep.get_step() != step.load(std::memory_order_relaxed)) {
+			timestep.set_step(step.load(std::memory_order_relaxed));
+		}
+		timestep.set_max_steps(max_steps.load(std::memory_order_relaxed));
+
+		const Clock::time_point now = Clock::now();
+		const unsigned count = timestep.advance(std::chrono::duration<float>(now - last).count());
+		last = now;
+		for (unsigned it = 0; it < count; it++) {
+			PROFILE_SCOPE("Context::update");
+			const Clock::time_point begin = Clock::now();
+			context->update(timestep.get_step());
+			update_ms.store(std::chrono::duration<float, std::milli>(Clock::now() - begin).count(), std::memory_order_relaxed);
+		}
+		steps.fetch_add(count, std::memory_order_relaxed);
+		if (timestep.get_stats().dropped > 0.f) {
+			dropped.store(dropped.load(std::memory_order_relaxed) + timestep.get_stats().dropped, std::memory_order_relaxed);
+		}
+
+		// Sleeps until the next step is due, runs late steps back to back
+		std::this_thread::sleep_for(std::chrono::duration<float>((1.f - timestep.get_alpha()) * timestep.get_step()));
+	}
+}
+
+} // namespace Engine
@@ -0,0 +1,89 @@
+/*
+    3D Physics Simulations - Simulation thread: runs the context updates concurrently with the rendering
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_SIMULATION_THREAD_HPP
+#define SIMULATION_SIMULATION_THREAD_HPP
+
+#include "fixed_timestep.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace Engine {
+
+class Context;
+
+// Runs `Context::update()` in fixed steps on a dedicated thread, so a heavy step does not lower the frame rate
+// Only for contexts that are `is_threadable()`: they hand their state to `render()` through a Lib::Triple_buffer
+class Simulation_thread {
+public:
+	struct Stats {
+		std::uint64_t steps = 0;
+		float dropped = 0.f; // seconds not simulated because of the clamp
+		float update_ms = 0.f; // duration of the last step
+	};
+
+	Simulation_thread() = default;
+	~Simulation_thread();
+	Simulation_thread(const Simulation_thread&) = delete;
+	Simulation_thread(Simulation_thread&&) = delete;
+	Simulation_thread& operator=(const Simulation_thread&) = delete;
+	Simulation_thread& operator=(Simulation_thread&&) = delete;
+
+	// Starts updating `ctx` with the step settings of `timestep`, stops the previous context first
+	void start(Context* ctx, const Fixed_timestep& timestep);
+	// Waits for the running step to finish, to switch or delete the context
+	void stop();
+	// The context being updated, nullptr when stopped
+	[[nodiscard]] Context* get_context() const { return context; }
+
+	// Applied from the next step
+	void set_timestep(const Fixed_timestep& timestep);
+
+	// Whether threadable contexts should be updated on this thread, the caller starts and stops it accordingly
+	void set_enabled(bool enable) { enabled = enable; }
+	[[nodiscard]] bool is_enabled() const { return enabled; }
+
+	[[nodiscard]] Stats get_stats() const;
+
+	// Appends a toggle and the stats to the "Simulation" window (see Fixed_timestep::draw_window)
+	void draw_window();
+
+private:
+	void run(Fixed_timestep timestep);
+
+	std::thread thread;
+	Context* context = nullptr;
+	bool enabled = false;
+	std::atomic<bool> quit{false};
+
+	// Settings
+	std::atomic<float> step{1.f / 60.f};
+	std::atomic<unsigned> max_steps{5};
+
+	// Stats
+	std::atomic<std::uint64_t> steps{0};
+	std::atomic<float> dropped{0.f};
+	std::atomic<float> update_ms{0.f};
+};
+
+} // namespace Engine
+
+#endif //SIMULATION_SIMULATION_THREAD_HPP
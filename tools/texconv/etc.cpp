@@ -0,0 +1,282 @@
+/*
+    3D Physics Simulations - Texconv: ETC2 and EAC block compression
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "etc.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace Texconv {
+
+// Intensity modifiers of ETC1 (pixel index 0: +a, 1: +b, 2: -a, 3: -b)
+static const int etc1_modifiers[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 }
+};
+
+// Modifiers of EAC, multiplied by the block multiplier
+static const int eac_modifiers[16][8] = {
+	{ -3, -6, -9, -15, 2, 5, 8, 14 },
+	{ -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 },
+	{ -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 },
+	{ -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },
+	{ -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },
+	{ -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 }
+};
+
+static int clamp_byte(int value)
+{
+	return std::clamp(value, 0, 255);
+}
+
+// The 8 pixels of subblock `sub` (0 or 1), as (x, y) coordinates in the block
+static void subblock_pixels(bool flip, int sub, int (&xs)[8], int (&ys)[8])
+{
+	for (int it = 0; it < 8; ++it) {
+		if (flip) { // 4x2 subblocks, top then bottom
+			xs[it] = it % 4;
+			ys[it] = sub * 2 + it / 4;
+		}
+		else { // 2x4 subblocks, left then right
+			xs[it] = sub * 2 + it / 4;
+			ys[it] = it % 4;
+		}
+	}
+}
+
+struct Subblock_fit {
+	int table = 0;
+	int indices[8] = {};
+	long error = std::numeric_limits<long>::max();
+};
+
+// Finds the modifier table and pixel indices that best fit the subblock for the given base colour
+static Subblock_fit fit_subblock(const uint8_t* rgba, bool flip, int sub, const int (&base)[3])
+{
+	int xs[8], ys[8];
+	subblock_pixels(flip, sub, xs, ys);
+
+	Subblock_fit best;
+	for (int table = 0; table < 8; ++table) {
+		const int modifiers[4] = { etc1_modifiers[table][0], etc1_modifiers[table][1], -etc1_modifiers[table][0], -etc1_modifiers[table][1] };
+		Subblock_fit fit;
+		fit.table = table;
+		fit.error = 0;
+		for (int px = 0; px < 8; ++px) {
+			const uint8_t* pixel = rgba + (ys[px] * 4 + xs[px]) * 4;
+			long best_error = std::numeric_limits<long>::max();
+			for (int index = 0; index < 4; ++index) {
+				long error = 0;
+				for (int c = 0; c < 3; ++c) {
+					const int diff = clamp_byte(base[c] + modifiers[index]) - pixel[c];
+					error += diff * diff;
+				}
+				if (error < best_error) {
+					best_error = error;
+					fit.indices[px] = index;
+				}
+			}
+			fit.error += best_error;
+		}
+		if (fit.error < best.error) {
+			best = fit;
+		}
+	}
+	return best;
+}
+
+static void subblock_average(const uint8_t* rgba, bool flip, int sub, float (&average)[3])
+{
+	int xs[8], ys[8];
+	subblock_pixels(flip, sub, xs, ys);
+	for (int c = 0; c < 3; ++c) {
+		int sum = 0;
+		for (int px = 0; px < 8; ++px) {
+			sum += rgba[(ys[px] * 4 + xs[px]) * 4 + c];
+		}
+		average[c] = sum / 8.f;
+	}
+}
+
+uint64_t encode_etc1_block(const uint8_t* rgba)
+{
+	uint64_t best_block = 0;
+	long best_error = std::numeric_limits<long>::max();
+
+	for (int flip = 0; flip < 2; ++flip) {
+		float averages[2][3];
+		subblock_average(rgba, flip, 0, averages[0]);
+		subblock_average(rgba, flip, 1, averages[1]);
+
+		// Differential mode: 5 bit base colour and a 3 bit signed delta for the second subblock
+		int q5[2][3];
+		bool delta_fits = true;
+		for (int c = 0; c < 3; ++c) {
+			q5[0][c] = static_cast<int>(averages[0][c] * 31.f / 255.f + .5f);
+			q5[1][c] = static_cast<int>(averages[1][c] * 31.f / 255.f + .5f);
+			const int delta = q5[1][c] - q5[0][c];
+			delta_fits = delta_fits && delta >= -4 && delta <= 3;
+		}
+		if (delta_fits) {
+			int bases[2][3];
+			for (int sub = 0; sub < 2; ++sub) {
+				for (int c = 0; c < 3; ++c) {
+					bases[sub][c] = (q5[sub][c] << 3) | (q5[sub][c] >> 2);
+				}
+			}
+			const Subblock_fit fits[2] = { fit_subblock(rgba, flip, 0, bases[0]), fit_subblock(rgba, flip, 1, bases[1]) };
+			if (fits[0].error + fits[1].error < best_error) {
+				best_error = fits[0].error + fits[1].error;
+				best_block = 0;
+				for (int c = 0; c < 3; ++c) {
+					best_block |= uint64_t(q5[0][c]) << (59 - c * 8);
+					best_block |= uint64_t((q5[1][c] - q5[0][c]) & 7) << (56 - c * 8);
+				}
+				best_block |= uint64_t(1) << 33; // diff bit
+				best_block |= uint64_t(fits[0].table) << 37 | uint64_t(fits[1].table) << 34 | uint64_t(flip) << 32;
+				for (int sub = 0; sub < 2; ++sub) {
+					int xs[8], ys[8];
+					subblock_pixels(flip, sub, xs, ys);
+					for (int px = 0; px < 8; ++px) {
+						const int bit = xs[px] * 4 + ys[px];
+						best_block |= uint64_t(fits[sub].indices[px] >> 1) << (16 + bit) | uint64_t(fits[sub].indices[px] & 1) << bit;
+					}
+				}
+			}
+		}
+
+		// Individual mode: two 4 bit base colours
+		int q4[2][3];
+		int bases[2][3];
+		for (int sub = 0; sub < 2; ++sub) {
+			for (int c = 0; c < 3; ++c) {
+				q4[sub][c] = static_cast<int>(averages[sub][c] * 15.f / 255.f + .5f);
+				bases[sub][c] = (q4[sub][c] << 4) | q4[sub][c];
+			}
+		}
+		const Subblock_fit fits[2] = { fit_subblock(rgba, flip, 0, bases[0]), fit_subblock(rgba, flip, 1, bases[1]) };
+		if (fits[0].error + fits[1].error < best_error) {
+			best_error = fits[0].error + fits[1].error;
+			best_block = 0;
+			for (int c = 0; c < 3; ++c) {
+				best_block |= uint64_t(q4[0][c]) << (60 - c * 8) | uint64_t(q4[1][c]) << (56 - c * 8);
+			}
+			best_block |= uint64_t(fits[0].table) << 37 | uint64_t(fits[1].table) << 34 | uint64_t(flip) << 32;
+			for (int sub = 0; sub < 2; ++sub) {
+				int xs[8], ys[8];
+				subblock_pixels(flip, sub, xs, ys);
+				for (int px = 0; px < 8; ++px) {
+					const int bit = xs[px] * 4 + ys[px];
+					best_block |= uint64_t(fits[sub].indices[px] >> 1) << (16 + bit) | uint64_t(fits[sub].indices[px] & 1) << bit;
+				}
+			}
+		}
+	}
+	return best_block;
+}
+
+uint64_t encode_eac_alpha_block(const uint8_t* rgba)
+{
+	int min_alpha = 255, max_alpha = 0;
+	for (int px = 0; px < 16; ++px) {
+		min_alpha = std::min<int>(min_alpha, rgba[px * 4 + 3]);
+		max_alpha = std::max<int>(max_alpha, rgba[px * 4 + 3]);
+	}
+
+	int best_base = min_alpha, best_multiplier = 1, best_table = 13; // table 13 has a zero modifier: exact for uniform blocks
+	int best_indices[16] = { 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4 };
+	if (min_alpha != max_alpha) {
+		long best_error = std::numeric_limits<long>::max();
+		for (int table = 0; table < 16; ++table) {
+			const int* modifiers = eac_modifiers[table];
+			for (int multiplier = 1; multiplier < 16; ++multiplier) {
+				// Centre the modifier range on the alpha range, then try its neighbours
+				const int centre = (min_alpha + max_alpha - (modifiers[3] + modifiers[7]) * multiplier) / 2;
+				for (int base = std::max(centre - 1, 0); base <= std::min(centre + 1, 255); ++base) {
+					long error = 0;
+					int indices[16];
+					for (int px = 0; px < 16 && error < best_error; ++px) {
+						long px_error = std::numeric_limits<long>::max();
+						for (int index = 0; index < 8; ++index) {
+							const int diff = clamp_byte(base + modifiers[index] * multiplier) - rgba[px * 4 + 3];
+							if (diff * diff < px_error) {
+								px_error = diff * diff;
+								indices[px] = index;
+							}
+						}
+						error += px_error;
+					}
+					if (error < best_error) {
+						best_error = error;
+						best_base = base;
+						best_multiplier = multiplier;
+						best_table = table;
+						std::copy(indices, indices + 16, best_indices);
+					}
+				}
+			}
+		}
+	}
+
+	uint64_t block = uint64_t(best_base) << 56 | uint64_t(best_multiplier) << 52 | uint64_t(best_table) << 48;
+	for (int px = 0; px < 16; ++px) {
+		const int bit = (px % 4) * 4 + px / 4; // column major, like ETC
+		block |= uint64_t(best_indices[px]) << (45 - bit * 3);
+	}
+	return block;
+}
+
+static void store_big_endian(uint64_t block, std::vector<uint8_t>& out)
+{
+	for (int shift = 56; shift >= 0; shift -= 8) {
+		out.push_back(static_cast<uint8_t>(block >> shift));
+	}
+}
+
+std::vector<uint8_t> compress(const uint8_t* rgba, int width, int height, bool alpha)
+{
+	std::vector<uint8_t> out;
+	out.reserve(((width + 3) / 4) * ((height + 3) / 4) * (alpha ? 16 : 8));
+
+	uint8_t block[16 * 4];
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			for (int y = 0; y < 4; ++y) {
+				for (int x = 0; x < 4; ++x) {
+					const uint8_t* pixel = rgba + (std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)) * 4;
+					std::copy(pixel, pixel + 4, block + (y * 4 + x) * 4);
+				}
+			}
+			if (alpha) {
+				store_big_endian(encode_eac_alpha_block(block), out);
+			}
+			store_big_endian(encode_etc1_block(block), out);
+		}
+	}
+	return out;
+}
+
+} // namespace Texconv
@@ -0,0 +1,40 @@
+/*
+    3D Physics Simulations - Texconv: ETC2 and EAC block compression
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#ifndef SIMULATION_TEXCONV_ETC_HPP
+#define SIMULATION_TEXCONV_ETC_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace Texconv {
+
+// Encodes a 4x4 block of RGBA pixels (row major) using the ETC1 modes only (a subset of ETC2 RGB8)
+uint64_t encode_etc1_block(const uint8_t* rgba);
+
+// Encodes the alpha of a 4x4 block of RGBA pixels (row major) as an 8 bit EAC block
+uint64_t encode_eac_alpha_block(const uint8_t* rgba);
+
+// Compresses an RGBA image to GL_COMPRESSED_RGB8_ETC2 or, if `alpha`, to GL_COMPRESSED_RGBA8_ETC2_EAC
+// Blocks are stored big endian, the border blocks of images not multiple of 4 repeat the last row/column
+std::vector<uint8_t> compress(const uint8_t* rgba, int width, int height, bool alpha);
+
+} // namespace Texconv
+
+#endif //SIMULATION_TEXCONV_ETC_HPP
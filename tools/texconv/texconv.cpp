@@ -0,0 +1,122 @@
+/*
+    3D Physics Simulations - Texconv: converts images to mipmapped ETC2 KTX textures
+    Copyright (C) 2020  Jonathan Bayle
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "etc.hpp"
+#include "../../src/renderer/ktx.hpp"
+
+#include <stb_image.h>
+
+// Only for the format enums
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using std::endl, std::cerr;
+
+namespace Texconv {
+
+struct Rgba_image {
+	int width, height;
+	std::vector<uint8_t> pixels;
+};
+
+// Box filters the image down to half its size (rounded down, at least 1)
+static Rgba_image downsample(const Rgba_image& image)
+{
+	Rgba_image half{ std::max(image.width / 2, 1), std::max(image.height / 2, 1), {} };
+	half.pixels.resize(half.width * half.height * 4);
+	for (int y = 0; y < half.height; ++y) {
+		for (int x = 0; x < half.width; ++x) {
+			const int x0 = std::min(x * 2, image.width - 1), x1 = std::min(x * 2 + 1, image.width - 1);
+			const int y0 = std::min(y * 2, image.height - 1), y1 = std::min(y * 2 + 1, image.height - 1);
+			for (int c = 0; c < 4; ++c) {
+				const int sum = image.pixels[(y0 * image.width + x0) * 4 + c] + image.pixels[(y0 * image.width + x1) * 4 + c] +
+				                image.pixels[(y1 * image.width + x0) * 4 + c] + image.pixels[(y1 * image.width + x1) * 4 + c];
+				half.pixels[(y * half.width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+	return half;
+}
+
+static void convert(const std::string& input, const std::string& output, bool mipmaps)
+{
+	// Same orientation as Engine::Renderer::Image
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	stbi_uc* raster = stbi_load(input.data(), &width, &height, &channels, 4);
+	if (raster == nullptr) {
+		throw std::runtime_error("texconv: Could not stbi_load file " + input);
+	}
+	Rgba_image image{ width, height, std::vector<uint8_t>(raster, raster + width * height * 4) };
+	stbi_image_free(raster);
+	const bool alpha = channels == 2 || channels == 4;
+
+	std::vector<std::vector<uint8_t>> levels;
+	levels.push_back(compress(image.pixels.data(), image.width, image.height, alpha));
+	while (mipmaps && (image.width > 1 || image.height > 1)) {
+		image = downsample(image);
+		levels.push_back(compress(image.pixels.data(), image.width, image.height, alpha));
+	}
+
+	Engine::Renderer::Ktx::Header header{};
+	std::memcpy(header.identifier, Engine::Renderer::Ktx::identifier, sizeof(header.identifier));
+	header.endianness = Engine::Renderer::Ktx::endianness;
+	header.gl_type_size = 1;
+	header.gl_internal_format = alpha ? GL_COMPRESSED_RGBA8_ETC2_EAC : GL_COMPRESSED_RGB8_ETC2;
+	header.gl_base_internal_format = alpha ? GL_RGBA : GL_RGB;
+	header.pixel_width = width;
+	header.pixel_height = height;
+	header.faces = 1;
+	header.mipmap_levels = static_cast<uint32_t>(levels.size());
+
+	std::ofstream file(output, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const std::vector<uint8_t>& level: levels) {
+		// Block sizes are multiples of 4, no mip padding needed
+		const uint32_t size = static_cast<uint32_t>(level.size());
+		file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+		file.write(reinterpret_cast<const char*>(level.data()), size);
+	}
+	if (!file) {
+		throw std::runtime_error("texconv: Could not write file " + output);
+	}
+}
+
+} // namespace Texconv
+
+int main(int argc, char** argv)
+{
+	if (argc < 3 || argc > 4 || (argc == 4 && std::string(argv[3]) != "--no-mipmaps")) {
+		cerr << "usage: " << argv[0] << " <input.png> <output.ktx> [--no-mipmaps]" << endl;
+		return 1;
+	}
+
+	try {
+		Texconv::convert(argv[1], argv[2], argc == 3);
+	}
+	catch (const std::exception& ex) {
+		cerr << ex.what() << endl;
+		return 1;
+	}
+	return 0;
+}